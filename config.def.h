@@ -8,6 +8,12 @@ static unsigned int systraypinning  = 0;   /* 0: sloppy systray follows selected
 static unsigned int systrayonleft   = 0;   /* 0: systray in the right corner, >0: systray on left of status text */
 static unsigned int systrayspacing  = 2;   /* systray spacing */
 static int systraypinningfailfirst  = 1;   /* 1: if pinning fails, display systray on the first monitor, False: display systray on the last monitor*/
+static const unsigned int eventslice = 4;  /* ms spent on queued non-input events before input is polled again */
+static const unsigned int cfginterval = 16; /* min ms between applied ConfigureRequests of a floating client */
+static const unsigned int titleinterval = 16; /* min ms between title refetches of a selected client */
+static const unsigned int synctimeout = 100; /* ms to wait for a _NET_WM_SYNC_REQUEST client to catch up while resizing */
+static const int refreshrate        = 0;   /* Hz to pace mouse moves/resizes at, 0: the monitor's RandR rate */
+static const int tiledopaque        = 0;   /* 1: tell compositors tiled clients are opaque, wrong for see-through terminals */
 static const int showsystray        = 1;   /* 0 means no systray */
 static const int showbar            = 1;   /* 0 means no bar */
 static int topbar                   = 1;   /* 0 means bottom bar */
@@ -45,15 +51,15 @@ static const Rule rules[] = {
    *	WM_CLASS(STRING) = instance, class
    *	WM_NAME(STRING) = title
    */
-  /* class         instance    title                tags-mask  isfloating  monitor  ignore-move-request grab-on-urgent scratch-key cant-be-swallowed is-term*/
-  { "st-256color", NULL,       NULL,                0,         0,          -1,      0,                  1,             0,          0,                1},
-  { "popupterm",   NULL,       NULL,                0,         1,          -1,      0,                  1,             0,          1,                0},
-  { "scratchpad",  NULL,       NULL,                0,         1,          -1,      0,                  1,            'S',         0,                1},
-  { "floatterm",   NULL,       NULL,                0,         1,          -1,      0,                  1,            'T',         0,                1},
-  { NULL,          NULL,       "st-vimmode",        0,         0,          -1,      0,                  1,             0,          0,                0},
-  { "net-runelite-client-RuneLite",     NULL, NULL, 1,         1,          -1,      1,                  1,             0,          0,                0},
-  { "net-runelite-launcher-Launcher",   NULL, NULL, 1,         1,          -1,      1,                  1,             0,          0,                0},
-  { NULL, NULL, "Event Tester",                     0,         0,          -1,      0,                  1,             0,          1,                0},
+  /* class         instance    title                tags-mask  isfloating  monitor  ignore-move-request grab-on-urgent scratch-key cant-be-swallowed is-term wireframe */
+  { "st-256color", NULL,       NULL,                0,         0,          -1,      0,                  1,             0,          0,                1,          0},
+  { "popupterm",   NULL,       NULL,                0,         1,          -1,      0,                  1,             0,          1,                0,          0},
+  { "scratchpad",  NULL,       NULL,                0,         1,          -1,      0,                  1,            'S',         0,                1,          0},
+  { "floatterm",   NULL,       NULL,                0,         1,          -1,      0,                  1,            'T',         0,                1,          0},
+  { NULL,          NULL,       "st-vimmode",        0,         0,          -1,      0,                  1,             0,          0,                0,          0},
+  { "net-runelite-client-RuneLite",     NULL, NULL, 1,         1,          -1,      1,                  1,             0,          0,                0,          1},
+  { "net-runelite-launcher-Launcher",   NULL, NULL, 1,         1,          -1,      1,                  1,             0,          0,                0,          1},
+  { NULL, NULL, "Event Tester",                     0,         0,          -1,      0,                  1,             0,          1,                0,          0},
 };
 
 /* layout(s) */
@@ -91,6 +97,7 @@ static Signal signals[] = {
   { 5,            setlayout,      {.v = &layouts[4]} },
   { 6,            setlayout,      {.v = &layouts[5]} },
   { 15,           toggleswal,     {0}                },
+  { 16,           dumpstats,      {0}                },
 };
 
 /* key definitions */
@@ -236,6 +243,8 @@ static Button buttons[] = {
   { ClkClientWin,         MODKEY,             Button1,        movemouse,      {0} },
   { ClkClientWin,         MODKEY,             Button2,        togglefloating, {0} },
   { ClkClientWin,         MODKEY,             Button3,        resizemouse,    {0} },
+  { ClkClientWin,         MODKEY|ShiftMask,   Button1,        movemouse,      {.i = 1} }, /* wireframe */
+  { ClkClientWin,         MODKEY|ShiftMask,   Button3,        resizemouse,    {.i = 1} }, /* wireframe */
   { ClkClientWin,         MODKEY|ControlMask, Button3,        aspectresize,   {0} },
   { ClkClientWin,         MODKEY|ControlMask, Button2,        center,         {0} },
   { ClkTagBar,            0,                  Button1,        view,           {0} },
@@ -14,6 +14,14 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# Xrandr, comment if you don't want it (used for refresh rates)
+XRANDRLIBS  = -lXrandr
+XRANDRFLAGS = -DXRANDR
+
+# XInput 2, comment if you don't want it (used for moving and resizing)
+XINPUTLIBS  = -lXi
+XINPUTFLAGS = -DXINPUT
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -23,10 +31,10 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -lm -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lX11-xcb -lxcb -lxcb-res ${KVMLIB}
+LIBS = -lm -L${X11LIB} -lX11 ${XINERAMALIBS} ${XRANDRLIBS} ${XINPUTLIBS} ${FREETYPELIBS} -lX11-xcb -lxcb -lxcb-res -lXext ${KVMLIB}
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS} ${XINPUTFLAGS}
 CFLAGS   = -ggdb3 -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS_DEBUG   = -ggdb3 -DDEBUG -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
@@ -225,6 +225,13 @@ drw_setscheme(Drw *drw, Clr *scm)
     drw->scheme = scm;
 }
 
+void
+drw_setdrawable(Drw *drw, Drawable d)
+{
+  if (drw)
+    drw->drawable = d;
+}
+
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert)
 {
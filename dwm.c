@@ -25,8 +25,10 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <math.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -41,8 +43,15 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib-xcb.h>
+#include <X11/extensions/sync.h>
+#ifdef XINPUT
+#include <X11/extensions/XInput2.h>
+#endif /* XINPUT */
 #include <xcb/res.h>
 #ifdef __OpenBSD__
 #include <sys/sysctl.h>
@@ -56,14 +65,17 @@
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
 #define CLEANMASK(mask)         (mask & ~(numlockmask|LockMask) & (ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask))
 #define GETINC(X)               ((X) - 2000)
+#define HASHMIX(H, X)           ((H) = ((H) ^ (unsigned long long)(X)) * 1099511628211ULL) /* FNV-1a */
 #define INC(X)                  ((X) + 2000)
 #define INTERSECT(x,y,w,h,m)    (MAX(0, MIN((x)+(w),(m)->wx+(m)->ww) - MAX((x),(m)->wx)) \
                                * MAX(0, MIN((y)+(h),(m)->wy+(m)->wh) - MAX((y),(m)->wy)))
 #define ISINC(X)                ((X) > 1000 && (X) < 3000)
 #define ISFULLSCREEN(C)         (C && (C->fstag != -1))
-#define ISVISIBLEONTAG(C, T)    (C->tags & T)
-#define ISVISIBLESTICKY(C)      (C->mon->sticky == C && (!C->mon->pertag->fullscreens[C->mon->pertag->curtag] || ISFULLSCREEN(C)))
-#define ISVISIBLE(C)            (C && C->mon && (C->mon->seltags == 1 || C->mon->seltags == 0) && (ISVISIBLEONTAG(C, C->mon->tagset[C->mon->seltags]) || ISVISIBLESTICKY(C)))
+#define BARFROZEN(M)            ((M)->visfull || ISFULLSCREEN((M)->sel)) /* bar hidden by fullscreen */
+#define FULLSCREEN(M, T)        (handleclient((M)->pertag->fullscreens[T]))
+#define STICKY(M)               (handleclient((M)->sticky))
+#define SWALLOWED(C)            (handleclient((C)->swallowing))
+#define ISVISIBLE(C)            ((C) && (C)->isvisible) /* see updatevisible() */
 #define PREVSEL                 3000
 #define LEFTSEL                 2000
 #define RIGHTSEL                1000
@@ -77,6 +89,12 @@
 #define TAGSLENGTH              (LENGTH(tags))
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
 #define TRUNC(X,A,B)            (MAX((A), MIN((X), (B))))
+#define NETBIT(A)               (1U << (A)) /* netatom index in Client wtype/wstate */
+#define ONTOPTYPES              (NETBIT(NetWMWindowTypeDialog) | NETBIT(NetWMWindowTypeSplash) \
+                                | NETBIT(NetWMWindowTypeToolbar) | NETBIT(NetWMWindowTypeUtility))
+#define POOLSLAB                64 /* clients per pool slab */
+#define LATBUCKETS              24 /* log2 microsecond latency histogram */
+#define PENDINGSLOTS            1024 /* power of two, see countqueued() */
 
 #define SYSTEM_TRAY_REQUEST_DOCK    0
 #define MAX_TOP_CLIENTS 100
@@ -98,14 +116,22 @@
 /* enums */
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel, SchemeUrg }; /* color schemes */
+enum { BarTags, BarTitle, BarStatus, BarLast }; /* bar parts, see drawbar() */
 enum { NetSupported, NetWMName, NetWMState, NetWMStateAbove, NetWMCheck,
        NetSystemTray, NetSystemTrayOP, NetSystemTrayOrientation, NetSystemTrayOrientationHorz,
        NetWMFullscreen, NetWMWindowTypeDialog, NetWMWindowTypeSplash, NetWMWindowTypeToolbar, NetWMWindowTypeUtility, NetActiveWindow, NetWMWindowType,
+       NetWMSyncRequest, NetWMSyncRequestCounter, NetWMBypassCompositor, NetWMOpaqueRegion,
        NetClientList, NetClientListStacking, NetDesktopNames, NetDesktopViewport, NetNumberOfDesktops, NetCurrentDesktop, NetLast }; /* EWMH atoms */
+/* Client wtype/wstate keep one NETBIT() per netatom, fails to build when
+ * an atom more would shift past the top bit */
+typedef char netbitsfit[NetLast <= 32 ? 1 : -1];
 enum { Manager, Xembed, XembedInfo, XLast }; /* Xembed atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
+enum { GrabUnknown, GrabFocused, GrabUnfocused }; /* button grab state */
+enum { PropUnknown, PropDeleted, PropSet }; /* cached property state */
+enum { EvInput, EvOther, EvLast }; /* event scheduling classes */
 
 typedef union {
   int i;
@@ -124,27 +150,64 @@ typedef struct {
 
 typedef struct Monitor Monitor;
 typedef struct Client Client;
+typedef struct Slab Slab;
+
+/* a Client reference that goes NULL once the client is freed */
+typedef struct {
+  Client *c;
+  unsigned int gen;
+} Handle;
 
 struct Client {
-  char name[256];
+  /* hot: read by every list walk, layout and bar draw; kept within the
+   * first 64 bytes */
+  Client *next;
+  Client *snext;
+  Monitor *mon;
+  Window win;
+  unsigned int tags;
+  unsigned int isfloating : 1, isfixed : 1, isurgent : 1, neverfocus : 1,
+               oldstate : 1, needresize : 1, alwaysontop : 1, hintsvalid : 1,
+               ignoremoverequest : 1, grabonurgent : 1, cmesetfs : 1,
+               titlestale : 1, /* name is out of date, refetched when shown */
+               isvisible : 1,
+               ownbypass : 1, /* _NET_WM_BYPASS_COMPOSITOR set by us */
+               ownopaque : 1; /* _NET_WM_OPAQUE_REGION is ours to set */
+  int x, y, w, h;
+  int bw;
+  int fstag;
+  /* cold */
+  Client *prev, *sprev;
+  unsigned int idxtags; /* what tagindex() last counted this client as */
+  unsigned int indexed : 1, idxurgent : 1, idxfloating : 1, possent : 1;
+  unsigned int wireframe : 1; /* move and resize by outline only */
   float mina, maxa;
   float cfact;
-  int x, y, w, h;
+  int oldx, oldy, oldw, oldh, oldbw;
+  int nextbw; /* border width to send along with a deferred needresize */
+  int sentx, senty; /* last position sent for win, valid if possent */
   int sfx, sfy, sfw, sfh; /* stored float geometry, used on mode revert */
-  int oldx, oldy, oldw, oldh;
-  int basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
-  int bw, oldbw;
+  int basew, baseh, incw, inch, maxw, maxh, minw, minh;
   int initx, inity;
-  unsigned int tags, cmesetfs;
-  int fstag, isfixed, isfloating, isurgent, neverfocus, oldstate, needresize;
-  int alwaysontop, ignoremoverequest, grabonurgent, noswallow, isterminal;
-  pid_t pid;
+  int grabstate; /* buttons currently grabbed on win */
+  unsigned int wtype, wstate; /* _NET_WM_WINDOW_TYPE and _NET_WM_STATE as NETBITs */
+  int cfgx, cfgy, cfgw, cfgh; /* pending ConfigureRequest, merged by cfgmask */
+  unsigned long cfgmask;
+  unsigned long long cfgtime; /* when a request was last applied */
+  unsigned long ncfgreq, ncfgapplied;
+  unsigned long long titletime; /* when name was last fetched */
+  int noswallow, isterminal;
   char scratchkey;
-  Client *next;
-  Client *snext;
-  Client *swallowing;
-  Monitor *mon;
-  Window win;
+  pid_t pid;
+  unsigned int gen; /* odd while allocated, see clientalloc() */
+  Handle swallowing;
+  int opaquew, opaqueh; /* last advertised opaque region, see updateopaque() */
+  char name[256];
+};
+
+struct Slab {
+  Client c[POOLSLAB];
+  Slab *next;
 };
 
 typedef struct {
@@ -173,16 +236,37 @@ struct Monitor {
   unsigned int sellt;
   unsigned int tagset[2];
   int topbar;
-  Client *sticky;
-  Client *clients;
+  int refresh;          /* Hz, 0 if unknown */
+  int relayout;         /* geometry or clients changed in updategeom() */
+  char output[32];      /* RandR monitor name, empty without RandR */
+  Handle sticky;
+  unsigned int vistags; /* visibility cache, see updatevisible() */
+  Client *vissticky, *visfull;
+  unsigned int opaquew; /* bar width last advertised as opaque */
+  Pixmap barbuf;        /* last frame of the bar, redrawn by the part */
+  unsigned int barbufw;
+  unsigned long long barhash[BarLast]; /* what each part of barbuf shows */
+  Client *clients, *clientstail;
   Client *sel;
-  Client *stack;
+  Client *stack, *stacktail;
   Monitor *next;
   Window barwin;
+  Window catchwin;      /* InputOnly, below all, tells when the pointer enters */
   const Layout *lt[2];
   Pertag *pertag;
 };
 
+/* state of an unplugged RandR monitor, picked up again by its name */
+typedef struct Parked Parked;
+struct Parked {
+  char output[32];
+  unsigned int tagset[2];
+  unsigned int seltags;
+  int topbar;
+  Pertag *pertag;
+  Parked *next;
+};
+
 typedef struct {
   const char *class;
   const char *instance;
@@ -195,6 +279,7 @@ typedef struct {
   const char scratchkey;
   int noswallow;
   int isterminal;
+  int wireframe;
 } Rule;
 
 /* Xresources preferences */
@@ -213,6 +298,7 @@ typedef struct {
 typedef struct {
   Window win;
   Client *icons;
+  unsigned int opaquew;
 } Systray;
 
 typedef struct {
@@ -221,6 +307,53 @@ typedef struct {
   const Arg arg;
 } Signal;
 
+typedef struct {
+  unsigned long n;
+  unsigned long long total, max; /* microseconds */
+} Stat;
+
+typedef struct {
+  Window *wins;
+  unsigned int n, size;
+} WinList;
+
+/* queued PropertyNotify or MotionNotify events sharing a key */
+typedef struct {
+  unsigned long gen;   /* slot is only valid in the batch of pendinggen */
+  int type, state;
+  Window win;
+  Atom atom;           /* None for MotionNotify */
+  unsigned int n;
+} Pending;
+
+/* an interactive move or resize, driven by dispatch() and flushdrag() */
+typedef struct {
+  int active;
+  Handle c;
+  int resize, wire;
+  int horizcorner, vertcorner;
+  int ptrx, ptry;               /* pointer when a move started */
+  int ocx, ocy, ocx2, ocy2;     /* client when the drag started */
+  double px, py;                /* latest pointer, subpixel with XI2 */
+  int moved;                    /* px, py not acted upon yet */
+  unsigned long long lasttime;  /* last update sent */
+  XSyncAlarm alarm;
+  long long syncvalue;
+  int syncwait;                 /* client still painting the last size */
+  int xidev;                    /* grabbed XI2 master pointer, 0 for a core grab */
+} Drag;
+
+typedef struct Prop Prop;
+struct Prop {
+  Window win;
+  Atom atom, type;
+  long val, newval;
+  int state, newstate;
+  int dirty;
+  Prop *next;  /* hash chain */
+  Prop *dnext; /* dirty list */
+};
+
 /* function declarations */
 static void applyrules(Client *c);
 static void dwmdebug(void);
@@ -233,11 +366,16 @@ static void attachbelow(Client *c);
 static void attachbottom(Client *c);
 static void attachabove(Client *c);
 static void cycleattachdir(const Arg *arg);
+static void delprop(Window w, Atom atom);
 static void attachstack(Client *c);
+static void attachafter(Client *c, Client *prev);
 static void buttonpress(XEvent *e);
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
+static Client *clientalloc(void);
+static void clientfree(Client *c);
+static Handle clienthandle(Client *c);
 static void clientmessage(XEvent *e);
 static void configure(Client *c);
 static void center(const Arg *arg);
@@ -245,45 +383,78 @@ static void configuremonlayout(Monitor *m);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
 static Monitor *createmon(void);
+#ifdef XRANDR
+static Monitor *createnamedmon(const char *output);
+#endif /* XRANDR */
 static void configureclientpos(Client *c, Window s, int pos);
+static void configurefloating(Client *c);
+static void commitclientlist(void);
 static void destroynotify(XEvent *e);
 static void deck(Monitor *m);
 static void dwindle(Monitor *m);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static void dispatch(XEvent *ev, int class, unsigned long long since);
+static void dragapply(Client *c, int final);
+static void dragend(int commit);
+static int dragevent(XEvent *ev);
+static int dragstart(Client *c, int resize, int wire, Cursor cur);
+static void dumpstats(const Arg *arg);
+static void drainenter(void);
 static void drawbar(Monitor *m);
 static void drawbars(void);
+static void drawoutline(int x, int y, int w, int h);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
 static int fakesignal(void);
+static int fullscreenontop(Monitor *m);
 static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
+static void flushbatch(void);
+static int flushconfigs(void);
+static int flushdrag(void);
+static int flushtitles(void);
+static unsigned long long frameinterval(int x, int y);
+static void flushprops(void);
+static void forgetprops(Window w);
 static Atom getatomprop(Client *c, Atom prop);
+static unsigned long long getmonotime(void);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
+static void getstatus(void);
 static unsigned int getsystraywidth();
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static int haswinprop(Window w, Atom prop);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
+static void hideoutline(void);
+static Client *handleclient(Handle h);
 static void grid(Monitor *m);
 static void incnmaster(const Arg *arg);
+static int iscatchwin(Window w);
+static Bool isinput(Display *dpy, XEvent *ev, XPointer arg);
+static Bool countqueued(Display *dpy, XEvent *ev, XPointer arg);
+static Pending *pendingslot(XEvent *ev, int add);
 static void resetnmaster(const Arg *arg);
 static void keypress(XEvent *e);
+static unsigned long long layouthash(Monitor *m);
 static void killclient(const Arg *arg);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
-static void motionnotify(XEvent *e);
+static void movewin(Client *c, int x, int y);
 static void movemouse(const Arg *arg);
 static Client *nexttiled(Client *c);
 static int parentiseditor(pid_t w);
 static void propertynotify(XEvent *e);
+static Prop *propentry(Window w, Atom atom);
 static void pushstack(const Arg *arg);
 static void quit(const Arg *arg);
+static void reindex(Client *c);
 static void raiseclient(Client *c);
 static Monitor *recttomon(int x, int y, int w, int h);
 static void removesystrayicon(Client *i);
@@ -294,11 +465,16 @@ static void resizemouse(const Arg *arg);
 static void resizerequest(XEvent *e);
 static void restack(Monitor *m);
 static void resetfact(const Arg *arg);
+static void retiremon(Monitor *m);
+#ifdef XRANDR
+static void rrscreenchange(XEvent *e);
+#endif /* XRANDR */
 static void run(void);
 static void runautostart(void);
 static void scan(void);
 static int sendevent(Window w, Atom proto, int m, long d0, long d1, long d2, long d3, long d4);
 static void sendmon(Client *c, Monitor *m);
+static void setbypass(Client *c, int bypass);
 static void setclientstate(Client *c, long state);
 static void setcurrentdesktop(void);
 static void setdesktopnames(void);
@@ -312,15 +488,26 @@ static void setlayout(const Arg *arg);
 static void setmfact(const Arg *arg);
 static void setcfact(const Arg *arg);
 static void setnumdesktops(void);
+static void setopaqueregion(Window win, unsigned int w, unsigned int h);
+static void setprop(Window w, Atom atom, Atom type, long val);
+static void setsentpos(Client *c, int x, int y);
 static void setup(void);
+static void setvisible(Client *c);
 static void setviewport(void);
 static void seturgent(Client *c, int urg);
-static void showhide(Client *c);
+static void showhide(Monitor *m);
 static void spawn(const Arg *arg);
+static void stackplace(Window w, Window sib, int mode);
+static void stackremove(Window w);
 static int stackpos(const Arg *arg);
 static Monitor *systraytomon(Monitor *m);
 static void spawnscratch(const Arg *arg);
+static XSyncAlarm syncalarm(Client *c, long long *value);
+static int syncresize(Client *c, XSyncAlarm alarm, long long value, int x, int y, int w, int h);
 static void tag(const Arg *arg);
+static void tagindex(Client *c, int add);
+static int tagsfloating(Monitor *m, unsigned int tagset);
+static void tagsoccupied(Monitor *m, unsigned int *occ, unsigned int *urg);
 static void tagmon(const Arg *arg);
 static void tile(Monitor *m);
 static void togglebar(const Arg *arg);
@@ -343,18 +530,29 @@ static void updatebarpos(Monitor *m);
 static void updatebars(void);
 static void updateclientlist(void);
 static int updategeom(void);
+static void updatemons(int w, int h);
+#ifdef XRANDR
+static int updaterrmons(int *dirty);
+#endif /* XRANDR */
 static void updatenumlockmask(void);
+static void updateopaque(Client *c);
+static void updateopaqueowner(Client *c);
+static void updaterefresh(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
 static void updatesystray(void);
 static void updatesystrayicongeom(Client *i, int w, int h);
 static void updatesystrayiconstate(Client *i, XPropertyEvent *ev);
 static void updatetitle(Client *c);
+static void updatevisible(Monitor *m);
+static void updatewinatoms(Client *c, int type, int state);
 static void updatewmhints(Client *c);
 static void view(const Arg *arg);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
 static Client *wintosystrayicon(Window w);
+static int wincmp(const void *a, const void *b);
+static void winlistadd(WinList *l, Window w);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
@@ -395,13 +593,41 @@ static void (*handler[LASTEvent]) (XEvent *) = {
   [KeyPress] = keypress,
   [MappingNotify] = mappingnotify,
   [MapRequest] = maprequest,
-  [MotionNotify] = motionnotify,
   [PropertyNotify] = propertynotify,
   [ResizeRequest] = resizerequest,
   [UnmapNotify] = unmapnotify
 };
-static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast];
+static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast], utf8string;
 static int running = 1;
+static unsigned long long evtime; /* when the current event was read */
+static unsigned long lathist[EvLast][LATBUCKETS]; /* read to dispatch latency */
+static unsigned long ncoalesced;
+static Pending pending[PENDINGSLOTS]; /* filled once per batch by countqueued() */
+static unsigned long pendinggen;
+static unsigned long nlayouthits, nlayoutruns;
+static Window outline[4]; /* wireframe move/resize, see drawoutline() */
+static int havesync, syncevbase; /* XSync extension, for _NET_WM_SYNC_REQUEST */
+#ifdef XINPUT
+static int havexi, xiopcode; /* XInput 2, for drags */
+#endif /* XINPUT */
+static Drag drag;
+#ifdef XRANDR
+static int haverandr, rrevbase; /* RandR 1.5 monitors */
+#endif /* XRANDR */
+static Parked *parked; /* pertag state of unplugged monitors */
+static Slab *slabs, *lastslab; /* client pool, in allocation order */
+static Client *freeclients;
+static unsigned int nslabs, npooled;
+static unsigned long nstale; /* handles found pointing at a freed client */
+static unsigned int cfgpending; /* clients with a queued ConfigureRequest */
+static int batchwait = -1; /* ms until throttled work in flushbatch() is due */
+static Client *clickfocus; /* focus deferred from buttonpress() */
+static Stat replaystat; /* ButtonPress dequeue to ReplayPointer */
+static WinList stackorder; /* committed stacking of clients and bars, bottom to top */
+static WinList netclients, netstacking; /* last written _NET_CLIENT_LIST{,_STACKING} */
+static int clientlistdirty;
+static int statusstale, systraystale; /* held back while their bar is frozen */
+static Prop *props[256], *dirtyprops; /* write-back cache of single item properties */
 static int swal = 1;
 static Cur *cursor[CurLast];
 static Clr **scheme;
@@ -422,7 +648,12 @@ struct Pertag {
   const Layout *ltidxs[LENGTH(tags) + 1][2]; /* matrix of tags and layouts indexes  */
   int showbars[LENGTH(tags) + 1]; /* display bar for the current tag */
   int attachdir[LENGTH(tags) + 1];
-  Client *fullscreens[LENGTH(tags) + 1]; /* array of fullscreen clients at pos tag */
+  Handle fullscreens[LENGTH(tags) + 1]; /* array of fullscreen clients at pos tag */
+  unsigned int nclients[LENGTH(tags)]; /* attached clients per tag, except tags == 255 */
+  unsigned int nurgent[LENGTH(tags)];
+  unsigned int nfloating[LENGTH(tags)];
+  unsigned long long lthash[LENGTH(tags) + 1]; /* layouthash() after the last arrange */
+  char ltsymbols[LENGTH(tags) + 1][16]; /* ltsymbol it produced */
 };
 
 /* compile-time check if all tags fit into an unsigned int bit array. */
@@ -446,7 +677,6 @@ applyrules(Client *c)
   unsigned int i;
   const Rule *r;
   Monitor *m;
-  Atom wintype;
   XClassHint ch = { NULL, NULL };
 
   /* rule matching */
@@ -462,7 +692,6 @@ applyrules(Client *c)
   XGetClassHint(dpy, c->win, &ch);
   class    = ch.res_class ? ch.res_class : broken;
   instance = ch.res_name  ? ch.res_name  : broken;
-  wintype  = getatomprop(c, netatom[NetWMWindowType]);
 
   for (i = 0; i < LENGTH(rules); i++) {
     r = &rules[i];
@@ -477,16 +706,14 @@ applyrules(Client *c)
       c->isterminal= r->isterminal;
       c->ignoremoverequest = r->ignoremoverequest;
       c->grabonurgent = r->grabonurgent;
+      c->wireframe = r->wireframe;
       for (m = mons; m && m->num != r->monitor; m = m->next);
       if (m)
         c->mon = m;
     }
   }
 
-  c->alwaysontop = 1 ? ((wintype == netatom[NetWMWindowTypeSplash]) ||
-    (wintype == netatom[NetWMWindowTypeToolbar]) ||
-    (wintype == netatom[NetWMWindowTypeDialog]) ||
-    (wintype == netatom[NetWMWindowTypeUtility])) : 0;
+  c->alwaysontop = (c->wtype & ONTOPTYPES) != 0;
 
   if (ch.res_class)
     XFree(ch.res_class);
@@ -587,9 +814,9 @@ void
 arrange(Monitor *m)
 {
   if (m)
-    showhide(m->stack);
+    showhide(m);
   else for (m = mons; m; m = m->next)
-    showhide(m->stack);
+    showhide(m);
   if (m) {
     arrangemon(m);
     restack(m);
@@ -602,16 +829,50 @@ arrange(Monitor *m)
 void
 arrangemon(Monitor *m)
 {
+  Pertag *pt = m->pertag;
+  unsigned long long h;
+
+  if (!m->lt[m->sellt]->arrange) {
+    strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol);
+    return;
+  }
+  /* the hash covers the clients' current geometry, so a match means the
+   * layout would put every client where it already is */
+  if ((h = layouthash(m)) == pt->lthash[pt->curtag]) {
+    memcpy(m->ltsymbol, pt->ltsymbols[pt->curtag], sizeof m->ltsymbol);
+    nlayouthits++;
+    return;
+  }
   strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol);
-  if (m->lt[m->sellt]->arrange)
-    m->lt[m->sellt]->arrange(m);
+  m->lt[m->sellt]->arrange(m);
+  pt->lthash[pt->curtag] = layouthash(m);
+  memcpy(pt->ltsymbols[pt->curtag], m->ltsymbol, sizeof m->ltsymbol);
+  nlayoutruns++;
+}
+
+/* inserts c into its monitor's client list after prev, or at the head */
+void
+attachafter(Client *c, Client *prev)
+{
+  Monitor *m = c->mon;
+
+  c->prev = prev;
+  c->next = prev ? prev->next : m->clients;
+  if (c->next)
+    c->next->prev = c;
+  else
+    m->clientstail = c;
+  if (prev)
+    prev->next = c;
+  else
+    m->clients = c;
+  tagindex(c, 1);
 }
 
 void
 attachtop(Client *c)
 {
-  c->next = c->mon->clients;
-  c->mon->clients = c;
+  attachafter(c, NULL);
 }
 
 void
@@ -622,10 +883,7 @@ attachbelow(Client *c)
     attachbottom(c);
     return;
   }
-  //Set the new client's next property to the same as the currently selected clients next
-  c->next = c->mon->sel->next;
-  //Set the currently selected clients next property to the new client
-  c->mon->sel->next = c;
+  attachafter(c, c->mon->sel);
 }
 
 void
@@ -636,22 +894,13 @@ attachabove(Client *c)
     return;
   }
 
-  Client *at;
-  for (at = c->mon->clients; at && at->next != c->mon->sel; at = at->next);
-  c->next = at->next;
-  at->next = c;
+  attachafter(c, c->mon->sel->prev);
 }
 
 void
 attachbottom(Client *c)
 {
-  Client *below = c->mon->clients;
-  for (; below && below->next; below = below->next);
-  c->next = NULL;
-  if (below)
-    below->next = c;
-  else
-    c->mon->clients = c;
+  attachafter(c, c->mon->clientstail);
 }
 
 void
@@ -697,12 +946,25 @@ swallow(Client *p, Client *c)
   setclientstate(p, WithdrawnState);
   XUnmapWindow(dpy, p->win);
 
-  p->swallowing = c;
+  p->swallowing = clienthandle(c);
   c->mon = p->mon;
+  if (c->cfgmask) {
+    c->cfgmask = 0;
+    cfgpending--;
+  }
 
   Window w = p->win;
   p->win = c->win;
   c->win = w;
+  int g = p->grabstate;
+  p->grabstate = c->grabstate;
+  c->grabstate = g;
+  unsigned int a = p->wtype;
+  p->wtype = c->wtype;
+  c->wtype = a;
+  a = p->wstate;
+  p->wstate = c->wstate;
+  c->wstate = a;
 
   if (p->scratchkey)
     raiseclient(p);
@@ -717,6 +979,7 @@ swallow(Client *p, Client *c)
   wc.border_width = p->bw;
   XConfigureWindow(dpy, p->win, CWBorderWidth, &wc);
   XMoveResizeWindow(dpy, p->win, p->x, p->y, p->w, p->h);
+  setsentpos(p, p->x, p->y);
   XSetWindowBorder(dpy, p->win, scheme[SchemeNorm][ColBorder].pixel);
   arrange(p->mon);
   configure(p);
@@ -727,13 +990,16 @@ void
 unswallow(Client *c)
 {
   XWindowChanges wc;
-  c->win = c->swallowing->win;
+  c->win = SWALLOWED(c)->win;
+  c->grabstate = SWALLOWED(c)->grabstate;
+  c->wtype = SWALLOWED(c)->wtype;
+  c->wstate = SWALLOWED(c)->wstate;
 
   /* unfullscreen the client */
-  if ISFULLSCREEN(c->swallowing)
-    setfullscreen(c->swallowing, 0, 0);
-  free(c->swallowing);
-  c->swallowing = NULL;
+  if ISFULLSCREEN(SWALLOWED(c))
+    setfullscreen(SWALLOWED(c), 0, 0);
+  clientfree(SWALLOWED(c));
+  c->swallowing = clienthandle(NULL);
 
   XDeleteProperty(dpy, c->win, netatom[NetClientList]);
 
@@ -744,6 +1010,7 @@ unswallow(Client *c)
   wc.border_width = c->bw;
   XConfigureWindow(dpy, c->win, CWBorderWidth, &wc);
   XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+  setsentpos(c, c->x, c->y);
   setclientstate(c, NormalState);
   focus(NULL);
   arrange(c->mon);
@@ -753,7 +1020,12 @@ unswallow(Client *c)
 void
 attachstack(Client *c)
 {
+  c->sprev = NULL;
   c->snext = c->mon->stack;
+  if (c->snext)
+    c->snext->sprev = c;
+  else
+    c->mon->stacktail = c;
   c->mon->stack = c;
 }
 
@@ -765,18 +1037,28 @@ buttonpress(XEvent *e)
   Client *c;
   Monitor *m;
   XButtonPressedEvent *ev = &e->xbutton;
+  unsigned long long t;
 
   click = ClkRootWin;
-  /* focus monitor if necessary */
-  if ((m = wintomon(ev->window)) && m != selmon) {
+  if ((c = wintoclient(ev->window))) {
+    /* let the click through before doing any work, the pointer is frozen
+     * by the sync grab of unfocused clients until then */
+    XAllowEvents(dpy, ReplayPointer, CurrentTime);
+    XFlush(dpy);
+    t = getmonotime() - evtime;
+    replaystat.n++;
+    replaystat.total += t;
+    replaystat.max = MAX(replaystat.max, t);
+    click = ClkClientWin;
+  } else if ((m = wintomon(ev->window)) && m != selmon) {
+    /* focus monitor if necessary */
     unfocus(selmon->sel, 1);
     selmon = m;
     focus(NULL);
   }
   if (ev->window == selmon->barwin) {
     i = x = 0;
-    for (c = m->clients; c; c = c->next)
-      occ |= c->tags == 255 ? 0 : c->tags;
+    tagsoccupied(m, &occ, NULL);
     do {
       /* do not reserve space for vacant tags */
       if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
@@ -792,13 +1074,21 @@ buttonpress(XEvent *e)
       click = ClkStatusText;
     else
       click = ClkWinTitle;
-  } else if ((c = wintoclient(ev->window))) {
-    focus(c);
-    restack(selmon);
-    XAllowEvents(dpy, ReplayPointer, CurrentTime);
-    click = ClkClientWin;
   }
   for (i = 0; i < LENGTH(buttons); i++)
+    if (click == buttons[i].click && buttons[i].func && buttons[i].button == ev->button
+    && CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
+      break;
+  if (click == ClkClientWin) {
+    /* bindings act on selmon->sel, so only a plain click may wait for the
+     * end of the event batch to focus and restack */
+    if (i < LENGTH(buttons)) {
+      focus(c);
+      restack(selmon);
+    } else
+      clickfocus = c;
+  }
+  for (; i < LENGTH(buttons); i++)
     if (click == buttons[i].click && buttons[i].func && buttons[i].button == ev->button
     && CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
       buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
@@ -821,6 +1111,7 @@ cleanup(void)
   Arg a = {.ui = ~0};
   Layout foo = { "", NULL };
   Monitor *m;
+  Parked *p;
   size_t i;
 
   view(&a);
@@ -828,20 +1119,37 @@ cleanup(void)
   for (m = mons; m; m = m->next)
     while (m->stack)
       unmanage(m->stack, 0);
+  commitclientlist();
   XUngrabKey(dpy, AnyKey, AnyModifier, root);
   while (mons)
     cleanupmon(mons);
+  while ((p = parked)) {
+    parked = p->next;
+    free(p->pertag);
+    free(p);
+  }
   if (showsystray) {
     XUnmapWindow(dpy, systray->win);
     XDestroyWindow(dpy, systray->win);
     free(systray);
   }
+  while (slabs) {
+    lastslab = slabs->next;
+    free(slabs);
+    slabs = lastslab;
+  }
+  free(stackorder.wins);
+  free(netclients.wins);
+  free(netstacking.wins);
   for (i = 0; i < CurLast; i++)
     drw_cur_free(drw, cursor[i]);
   for (i = 0; i < LENGTH(colors); i++)
     free(scheme[i]);
   free(scheme);
   XDestroyWindow(dpy, wmcheckwin);
+  for (i = 0; i < 4; i++)
+    if (outline[i])
+      XDestroyWindow(dpy, outline[i]);
   drw_free(drw);
   XSync(dpy, False);
   XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
@@ -861,10 +1169,62 @@ cleanupmon(Monitor *mon)
   }
   XUnmapWindow(dpy, mon->barwin);
   XDestroyWindow(dpy, mon->barwin);
+  stackremove(mon->barwin);
+  XDestroyWindow(dpy, mon->catchwin);
+  if (mon->barbuf)
+    XFreePixmap(dpy, mon->barbuf);
   free(mon->pertag);
   free(mon);
 }
 
+/* clients and systray icons come from slabs of POOLSLAB, the generation
+ * count is bumped on both alloc and free so Handles can spot reuse */
+Client *
+clientalloc(void)
+{
+  Client *c;
+  Slab *s;
+  unsigned int gen;
+  int i;
+
+  if (!freeclients) {
+    s = ecalloc(1, sizeof(Slab));
+    if (lastslab)
+      lastslab->next = s;
+    else
+      slabs = s;
+    lastslab = s;
+    nslabs++;
+    for (i = POOLSLAB - 1; i >= 0; i--) {
+      s->c[i].next = freeclients;
+      freeclients = &s->c[i];
+    }
+  }
+  c = freeclients;
+  freeclients = c->next;
+  gen = c->gen;
+  memset(c, 0, sizeof(Client));
+  c->gen = gen + 1;
+  npooled++;
+  return c;
+}
+
+void
+clientfree(Client *c)
+{
+  c->gen++;
+  c->next = freeclients;
+  freeclients = c;
+  npooled--;
+}
+
+Handle
+clienthandle(Client *c)
+{
+  Handle h = { c, c ? c->gen : 0 };
+  return h;
+}
+
 void
 clientmessage(XEvent *e)
 {
@@ -876,10 +1236,9 @@ clientmessage(XEvent *e)
   if (showsystray && cme->window == systray->win && cme->message_type == netatom[NetSystemTrayOP]) {
     /* add systray icons */
     if (cme->data.l[1] == SYSTEM_TRAY_REQUEST_DOCK) {
-      if (!(c = (Client *)calloc(1, sizeof(Client))))
-        die("fatal: could not malloc() %u bytes\n", sizeof(Client));
+      c = clientalloc();
       if (!(c->win = cme->data.l[2])) {
-        free(c);
+        clientfree(c);
         return;
       }
       c->mon = selmon;
@@ -989,6 +1348,12 @@ configuremonlayout(Monitor *m)
   int hasfloat = 0;
   Window sib;
 
+  /* nothing floats above the tiled clients, skip the walk */
+  if (m->lt[m->sellt]->arrange && m->lt[m->sellt]->arrange != monocle
+  && m->lt[m->sellt]->arrange != deck && !tagsfloating(m, m->vistags)
+  && !(m->vissticky && m->vissticky->isfloating))
+    return;
+
   for (c = m->stack; c; c = c->snext) {
     if (ISVISIBLE(c)) {
       if (i < MAX_TOP_CLIENTS && c->alwaysontop && c->isfloating) {
@@ -1047,80 +1412,41 @@ configuremonlayout(Monitor *m)
 void
 configurenotify(XEvent *e)
 {
-  Monitor *m;
-  Client *c;
   XConfigureEvent *ev = &e->xconfigure;
-  int dirty;
 
-  /* TODO: updategeom handling sucks, needs to be simplified */
-  if (ev->window == root) {
-    dirty = (sw != ev->width || sh != ev->height);
-    sw = ev->width;
-    sh = ev->height;
-    if (updategeom() || dirty) {
-      drw_resize(drw, sw, bh);
-      updatebars();
-      for (m = mons; m; m = m->next) {
-        for (c = m->clients; c; c = c->next)
-          if (ISFULLSCREEN(c) && ISVISIBLE(c))
-            resizeclient(c, m->mx, m->my, m->mw, m->mh);
-        resizebarwin(m);
-      }
-      focus(NULL);
-      arrange(NULL);
-    }
-  }
+  if (ev->window == root)
+    updatemons(ev->width, ev->height);
 }
 
 void
 configurerequest(XEvent *e)
 {
   Client *c;
-  Monitor *m;
   XConfigureRequestEvent *ev = &e->xconfigurerequest;
   XWindowChanges wc;
 
   if ((c = wintoclient(ev->window))) {
     if (ev->value_mask & CWBorderWidth)
       c->bw = ev->border_width;
-    else if ((c->isfloating && !ISFULLSCREEN(c) && !c->swallowing) || !selmon->lt[selmon->sellt]->arrange) {
-      m = c->mon;
-      if (!c->ignoremoverequest) {
-        if (ev->value_mask & CWX) {
-          c->oldx = c->x;
-          c->x = m->mx + ev->x;
-        }
-        if (ev->value_mask & CWY) {
-          c->oldy = c->y;
-          c->y = m->my + ev->y;
-        }
-      }
-      if (ev->value_mask & CWX) {
-        c->oldx = c->x;
-        c->x = m->mx + ev->x;
-      }
-      if (ev->value_mask & CWY) {
-        c->oldy = c->y;
-        c->y = m->my + ev->y;
-      }
-      if (ev->value_mask & CWWidth) {
-        c->oldw = c->w;
-        c->w = ev->width;
-      }
-      if (ev->value_mask & CWHeight) {
-        c->oldh = c->h;
-        c->h = ev->height;
-      }
-      if ((c->x + c->w) > m->mx + m->mw && c->isfloating)
-        c->x = m->mx + (m->mw / 2 - WIDTH(c) / 2); /* center in x direction */
-      if ((c->y + c->h) > m->my + m->mh && c->isfloating)
-        c->y = m->my + (m->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
-      if ((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
+    else if ((c->isfloating && !ISFULLSCREEN(c) && !SWALLOWED(c)) || !selmon->lt[selmon->sellt]->arrange) {
+      /* floating clients may send these in bursts, keep only the latest
+       * value of each field and apply them from flushbatch() */
+      if (!(ev->value_mask & (CWX|CWY|CWWidth|CWHeight))) {
         configure(c);
-      if (ISVISIBLE(c))
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-      else
-        c->needresize = 1;
+        return;
+      }
+      if (ev->value_mask & CWX)
+        c->cfgx = ev->x;
+      if (ev->value_mask & CWY)
+        c->cfgy = ev->y;
+      if (ev->value_mask & CWWidth)
+        c->cfgw = ev->width;
+      if (ev->value_mask & CWHeight)
+        c->cfgh = ev->height;
+      if (!c->cfgmask)
+        cfgpending++;
+      c->cfgmask |= ev->value_mask & (CWX|CWY|CWWidth|CWHeight);
+      c->ncfgreq++;
     } else
       configure(c);
   } else {
@@ -1133,7 +1459,58 @@ configurerequest(XEvent *e)
     wc.stack_mode = ev->detail;
     XConfigureWindow(dpy, ev->window, ev->value_mask, &wc);
   }
-  XSync(dpy, False);
+}
+
+void
+configurefloating(Client *c)
+{
+  Monitor *m = c->mon;
+
+  c->ncfgapplied++;
+  c->cfgtime = getmonotime();
+  if (!((c->isfloating && !ISFULLSCREEN(c) && !SWALLOWED(c)) || !selmon->lt[selmon->sellt]->arrange)) {
+    configure(c);
+    return;
+  }
+  if (!c->ignoremoverequest) {
+    if (c->cfgmask & CWX) {
+      c->oldx = c->x;
+      c->x = m->mx + c->cfgx;
+    }
+    if (c->cfgmask & CWY) {
+      c->oldy = c->y;
+      c->y = m->my + c->cfgy;
+    }
+  }
+  if (c->cfgmask & CWX) {
+    c->oldx = c->x;
+    c->x = m->mx + c->cfgx;
+  }
+  if (c->cfgmask & CWY) {
+    c->oldy = c->y;
+    c->y = m->my + c->cfgy;
+  }
+  if (c->cfgmask & CWWidth) {
+    c->oldw = c->w;
+    c->w = c->cfgw;
+  }
+  if (c->cfgmask & CWHeight) {
+    c->oldh = c->h;
+    c->h = c->cfgh;
+  }
+  if ((c->x + c->w) > m->mx + m->mw && c->isfloating)
+    c->x = m->mx + (m->mw / 2 - WIDTH(c) / 2); /* center in x direction */
+  if ((c->y + c->h) > m->my + m->mh && c->isfloating)
+    c->y = m->my + (m->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
+  if ((c->cfgmask & (CWX|CWY)) && !(c->cfgmask & (CWWidth|CWHeight)))
+    configure(c);
+  if (ISVISIBLE(c)) {
+    XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+    setsentpos(c, c->x, c->y);
+  } else {
+    c->nextbw = c->bw;
+    c->needresize = 1;
+  }
 }
 
 void
@@ -1143,6 +1520,47 @@ configureclientpos(Client *c, Window s, int pos)
   wc.stack_mode = pos;
   wc.sibling = s;
   XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
+  stackplace(c->win, s, pos);
+}
+
+/* _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING are rebuilt from memory and
+ * only written when they differ from what the root window already has */
+void
+commitclientlist(void)
+{
+  static WinList cur, sorted;
+  Client *c;
+  Monitor *m;
+  unsigned int i;
+
+  clientlistdirty = 0;
+  cur.n = sorted.n = 0;
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next) {
+      winlistadd(&cur, c->win);
+      winlistadd(&sorted, c->win);
+    }
+  if (cur.n != netclients.n || memcmp(cur.wins, netclients.wins, cur.n * sizeof(Window))) {
+    XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeReplace,
+      (unsigned char *)cur.wins, cur.n);
+    netclients.n = 0;
+    for (i = 0; i < cur.n; i++)
+      winlistadd(&netclients, cur.wins[i]);
+  }
+  /* stacking order as committed by stackplace(), restricted to clients */
+  if (sorted.n)
+    qsort(sorted.wins, sorted.n, sizeof(Window), wincmp);
+  cur.n = 0;
+  for (i = 0; i < stackorder.n; i++)
+    if (sorted.n && bsearch(&stackorder.wins[i], sorted.wins, sorted.n, sizeof(Window), wincmp))
+      winlistadd(&cur, stackorder.wins[i]);
+  if (cur.n != netstacking.n || memcmp(cur.wins, netstacking.wins, cur.n * sizeof(Window))) {
+    XChangeProperty(dpy, root, netatom[NetClientListStacking], XA_WINDOW, 32, PropModeReplace,
+      (unsigned char *)cur.wins, cur.n);
+    netstacking.n = 0;
+    for (i = 0; i < cur.n; i++)
+      winlistadd(&netstacking, cur.wins[i]);
+  }
 }
 
 Monitor *
@@ -1158,7 +1576,7 @@ createmon(void)
   m->topbar = topbar;
   m->lt[0] = &layouts[0];
   m->lt[1] = &layouts[1 % LENGTH(layouts)];
-  m->sticky = NULL;
+  m->sticky = clienthandle(NULL);
   strncpy(m->ltsymbol, layouts[0].symbol, sizeof m->ltsymbol);
   m->pertag = ecalloc(1, sizeof(Pertag));
   m->pertag->curtag = m->pertag->prevtag = 1;
@@ -1175,18 +1593,60 @@ createmon(void)
 
     m->pertag->showbars[i] = showbar;
     m->pertag->attachdir[i] = defaultatchdir;
-    m->pertag->fullscreens[i] = NULL;
+    m->pertag->fullscreens[i] = clienthandle(NULL);
   }
+  updatevisible(m);
 
   return m;
 }
 
+#ifdef XRANDR
+/* a monitor for a RandR output, with the state it had when it was unplugged */
+Monitor *
+createnamedmon(const char *output)
+{
+  Monitor *m = createmon();
+  Parked *p, **pp;
+  unsigned int i, t;
+
+  strncpy(m->output, output, sizeof m->output - 1);
+  for (pp = &parked; *pp && strcmp((*pp)->output, output); pp = &(*pp)->next);
+  if (!(p = *pp))
+    return m;
+  *pp = p->next;
+  free(m->pertag);
+  m->pertag = p->pertag;
+  m->tagset[0] = p->tagset[0];
+  m->tagset[1] = p->tagset[1];
+  m->seltags = p->seltags;
+  m->topbar = p->topbar;
+  free(p);
+  /* its clients went elsewhere, so nothing it remembers about them holds */
+  for (i = 0; i <= LENGTH(tags); i++) {
+    m->pertag->fullscreens[i] = clienthandle(NULL);
+    m->pertag->lthash[i] = 0;
+  }
+  t = m->pertag->curtag;
+  m->nmaster = m->pertag->nmasters[t];
+  m->mfact = m->pertag->mfacts[t];
+  m->sellt = m->pertag->sellts[t];
+  m->lt[m->sellt] = m->pertag->ltidxs[t][m->sellt];
+  m->lt[m->sellt^1] = m->pertag->ltidxs[t][m->sellt^1];
+  strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol - 1);
+  updatevisible(m);
+  return m;
+}
+#endif /* XRANDR */
+
 void
 destroynotify(XEvent *e)
 {
   Client *c;
   XDestroyWindowEvent *ev = &e->xdestroywindow;
 
+  stackremove(ev->window);
+  forgetprops(ev->window);
+
   if ((c = wintoclient(ev->window)))
     unmanage(c, 1);
   if ((c = wintosystrayicon(ev->window))) {
@@ -1195,7 +1655,7 @@ destroynotify(XEvent *e)
     updatesystray();
   }
   if ((c = swallowingclient(ev->window)))
-    unmanage(c->swallowing, 1);
+    unmanage(SWALLOWED(c), 1);
 }
 
 void
@@ -1233,19 +1693,39 @@ deck(Monitor *m)
 void
 detach(Client *c)
 {
-  Client **tc;
+  Monitor *m = c->mon;
 
-  for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
-  *tc = c->next;
+  if (!c->prev && m->clients != c)
+    return; /* not attached */
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    m->clients = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  else
+    m->clientstail = c->prev;
+  c->next = c->prev = NULL;
+  tagindex(c, 0);
 }
 
 void
 detachstack(Client *c)
 {
-  Client **tc, *t;
+  Monitor *m = c->mon;
+  Client *t;
 
-  for (tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext);
-  *tc = c->snext;
+  if (c->sprev || m->stack == c) {
+    if (c->sprev)
+      c->sprev->snext = c->snext;
+    else
+      m->stack = c->snext;
+    if (c->snext)
+      c->snext->sprev = c->sprev;
+    else
+      m->stacktail = c->sprev;
+    c->snext = c->sprev = NULL;
+  }
 
   if (c == c->mon->sel) {
     for (t = c->mon->stack; t && !ISVISIBLE(t); t = t->snext);
@@ -1253,6 +1733,53 @@ detachstack(Client *c)
   }
 }
 
+void
+dispatch(XEvent *ev, int class, unsigned long long since)
+{
+  unsigned long long t = getmonotime() - since;
+  int i;
+
+  for (i = 0; i < LATBUCKETS - 1 && t >> i; i++);
+  lathist[class][i]++;
+  evtime = since;
+  if (drag.active && dragevent(ev))
+    return;
+  if (ev->type < LASTEvent && handler[ev->type]) /* alarms may arrive late */
+    handler[ev->type](ev); /* call handler */
+#ifdef XRANDR
+  else if (haverandr && ev->type == rrevbase + RRScreenChangeNotify)
+    rrscreenchange(ev);
+#endif /* XRANDR */
+}
+
+void
+dumpstats(const Arg *arg)
+{
+  static const char *classes[] = { [EvInput] = "input", [EvOther] = "other" };
+  Slab *s;
+  Client *c;
+  int i, j;
+
+  fprintf(stderr, "dwm: click replay: n=%lu avg=%lluus max=%lluus\n",
+    replaystat.n, replaystat.n ? replaystat.total / replaystat.n : 0, replaystat.max);
+  for (i = 0; i < EvLast; i++) {
+    fprintf(stderr, "dwm: %s latency:", classes[i]);
+    for (j = 0; j < LATBUCKETS; j++)
+      if (lathist[i][j])
+        fprintf(stderr, " <%lluus:%lu", 1ULL << j, lathist[i][j]);
+    fputc('\n', stderr);
+  }
+  fprintf(stderr, "dwm: coalesced events: %lu\n", ncoalesced);
+  fprintf(stderr, "dwm: layouts: run %lu skipped %lu\n", nlayoutruns, nlayouthits);
+  fprintf(stderr, "dwm: client pool: %u/%u in %u slabs, stale handles %lu\n",
+    npooled, nslabs * POOLSLAB, nslabs, nstale);
+  for (s = slabs; s; s = s->next)
+    for (i = 0; i < POOLSLAB; i++)
+      if ((c = &s->c[i])->gen & 1 && c->ncfgreq)
+        fprintf(stderr, "dwm: configure requests: %s: %lu applied %lu\n",
+          c->name, c->ncfgreq, c->ncfgapplied);
+}
+
 Monitor *
 dirtomon(int dir)
 {
@@ -1268,64 +1795,335 @@ dirtomon(int dir)
   return m;
 }
 
+/* moves or resizes the dragged client after the pointer at drag.px, drag.py,
+ * final is for the release, which gets applied whatever the pacing */
+void
+dragapply(Client *c, int final)
+{
+  Monitor *m = c->mon;
+  int x = lround(drag.px), y = lround(drag.py);
+  int nx, ny, nw, nh;
+
+  if (!drag.resize) {
+    nx = drag.ocx + (x - drag.ptrx);
+    ny = drag.ocy + (y - drag.ptry);
+    nw = c->w;
+    nh = c->h;
+    if (abs(m->wx - nx) < snap)
+      nx = m->wx;
+    else if (abs((m->wx + m->ww) - (nx + WIDTH(c))) < snap)
+      nx = m->wx + m->ww - WIDTH(c);
+    if (abs(m->wy - ny) < snap)
+      ny = m->wy;
+    else if (abs((m->wy + m->wh) - (ny + HEIGHT(c))) < snap)
+      ny = m->wy + m->wh - HEIGHT(c);
+    if (!c->isfloating && m->lt[m->sellt]->arrange && c == selmon->sel
+    && (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
+      togglefloating(NULL);
+  } else {
+    nx = drag.horizcorner ? x : c->x;
+    ny = drag.vertcorner ? y : c->y;
+    nw = MAX(drag.horizcorner ? (drag.ocx2 - nx) : (x - drag.ocx - 2 * c->bw + 1), 1);
+    nh = MAX(drag.vertcorner ? (drag.ocy2 - ny) : (y - drag.ocy - 2 * c->bw + 1), 1);
+    if (m->wx + nw >= m->wx && m->wx + nw <= m->wx + m->ww
+    && m->wy + nh >= m->wy && m->wy + nh <= m->wy + m->wh
+    && !c->isfloating && m->lt[m->sellt]->arrange && c == selmon->sel
+    && (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
+      togglefloating(NULL);
+  }
+  if (m->lt[m->sellt]->arrange && !c->isfloating)
+    return;
+  if (final)
+    resize(c, nx, ny, nw, nh, 1);
+  else if (drag.wire) {
+    if (drag.resize)
+      applysizehints(c, &nx, &ny, &nw, &nh, 1);
+    drawoutline(nx, ny, nw + 2 * c->bw, nh + 2 * c->bw);
+  } else if (drag.alarm) {
+    /* motion within one size increment must not hold the drag up */
+    if (!applysizehints(c, &nx, &ny, &nw, &nh, 1))
+      return;
+    if ((drag.syncwait = syncresize(c, drag.alarm, drag.syncvalue + 1, nx, ny, nw, nh)))
+      drag.syncvalue++;
+  } else
+    resize(c, nx, ny, nw, nh, 1);
+}
+
+/* ends the drag, commit applies the geometry the pointer was left at */
+void
+dragend(int commit)
+{
+  Client *c = handleclient(drag.c);
+  Monitor *m;
+
+  drag.active = 0;
+  if (drag.wire)
+    hideoutline();
+  if (c && commit)
+    dragapply(c, 1);
+  if (drag.alarm) {
+    /* gone with the counter if the client went away */
+    XSetErrorHandler(xerrordummy);
+    XSyncDestroyAlarm(dpy, drag.alarm);
+    XSync(dpy, False);
+    XSetErrorHandler(xerror);
+  }
+  if (c && drag.resize)
+    XWarpPointer(dpy, None, c->win, 0, 0, 0, 0,
+        drag.horizcorner ? (-c->bw) : (c->w + c->bw - 1),
+        drag.vertcorner ? (-c->bw) : (c->h + c->bw - 1));
+#ifdef XINPUT
+  if (drag.xidev)
+    XIUngrabDevice(dpy, drag.xidev, CurrentTime);
+  else
+#endif /* XINPUT */
+    XUngrabPointer(dpy, CurrentTime);
+  if (drag.resize)
+    drainenter();
+  if (c && commit && (m = recttomon(c->x, c->y, c->w, c->h)) != c->mon) {
+    sendmon(c, m);
+    selmon = m;
+    focus(NULL);
+  }
+}
+
+/* takes the pointer events of a drag, everything else goes on to the
+ * handlers while dragging */
+int
+dragevent(XEvent *ev)
+{
+  switch (ev->type) {
+  case ButtonPress:
+    return 1;
+  case ButtonRelease:
+    /* input is served ahead of queued motion, the release knows where */
+    drag.px = ev->xbutton.x_root;
+    drag.py = ev->xbutton.y_root;
+    dragend(1);
+    return 1;
+  case MotionNotify:
+    drag.px = ev->xmotion.x_root;
+    drag.py = ev->xmotion.y_root;
+    drag.moved = 1;
+    return 1;
+#ifdef XINPUT
+  case GenericEvent:
+    if (!drag.xidev || ev->xcookie.extension != xiopcode
+    || !XGetEventData(dpy, &ev->xcookie))
+      return 0;
+    if (ev->xcookie.evtype == XI_Motion || ev->xcookie.evtype == XI_ButtonRelease) {
+      drag.px = ((XIDeviceEvent *)ev->xcookie.data)->root_x;
+      drag.py = ((XIDeviceEvent *)ev->xcookie.data)->root_y;
+      drag.moved = 1;
+    }
+    if (ev->xcookie.evtype == XI_ButtonRelease)
+      dragend(1);
+    XFreeEventData(dpy, &ev->xcookie);
+    return 1;
+#endif /* XINPUT */
+  }
+  if (drag.alarm && ev->type == syncevbase + XSyncAlarmNotify
+  && ((XSyncAlarmNotifyEvent *)ev)->alarm == drag.alarm) {
+    /* previous size painted, flushdrag() may send the next */
+    drag.syncwait = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/* grabs the pointer for a drag of c, through XI2 when the server has it */
+int
+dragstart(Client *c, int resize, int wire, Cursor cur)
+{
+#ifdef XINPUT
+  unsigned char mask[XIMaskLen(XI_LASTEVENT)] = {0};
+  XIEventMask em = { .mask_len = sizeof mask, .mask = mask };
+#endif /* XINPUT */
+
+  memset(&drag, 0, sizeof drag);
+  drag.c = clienthandle(c);
+  drag.resize = resize;
+  drag.wire = wire;
+  drag.ocx = c->x;
+  drag.ocy = c->y;
+  drag.ocx2 = c->x + c->w;
+  drag.ocy2 = c->y + c->h;
+#ifdef XINPUT
+  XISetMask(mask, XI_ButtonPress);
+  XISetMask(mask, XI_ButtonRelease);
+  XISetMask(mask, XI_Motion);
+  if (havexi && XIGetClientPointer(dpy, None, &drag.xidev)) {
+    em.deviceid = drag.xidev;
+    if (XIGrabDevice(dpy, drag.xidev, root, CurrentTime, cur, XIGrabModeAsync,
+      XIGrabModeAsync, False, &em) == GrabSuccess)
+      return drag.active = 1;
+  }
+  drag.xidev = 0;
+#endif /* XINPUT */
+  if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
+    None, cur, CurrentTime) != GrabSuccess)
+    return 0;
+  return drag.active = 1;
+}
+
+/* drops the crossings a restack or warp leaves behind; one into a catch
+ * window still means the pointer moved to another monitor */
+void
+drainenter(void)
+{
+  XEvent ev;
+  Monitor *m;
+  int x, y, crossed = 0;
+
+  while (XCheckMaskEvent(dpy, EnterWindowMask, &ev))
+    crossed |= iscatchwin(ev.xcrossing.window);
+  if (!crossed || !getrootptr(&x, &y) || (m = recttomon(x, y, 1, 1)) == selmon)
+    return;
+  unfocus(selmon->sel, 1);
+  selmon = m;
+  focus(NULL);
+}
+
 void
 drawbar(Monitor *m)
 {
-  int x, w, tw = 0, stw = 0;
+  int x, w, sx, tw = 0, stw = 0, redraw;
   int boxs = drw->fonts->h / 9;
   int boxw = drw->fonts->h / 6 + 2;
+  int dx0, dx1;
   char symbol_and_orei[10];
   unsigned int i, occ = 0, urg = 0;
+  unsigned long long h[BarLast];
+  const char *p;
+  Drawable shared;
   Client *c;
 
-  if (!m->pertag->showbars[m->pertag->curtag] || ISFULLSCREEN(m->sel) || m->pertag->fullscreens[m->pertag->curtag])
+  if (!m->pertag->showbars[m->pertag->curtag] || BARFROZEN(m))
     return;
 
   if (showsystray && m == systraytomon(m) && !systrayonleft)
     stw = getsystraywidth();
-
   if (m == selmon) {
-    /* draw status first so it can be overdrawn by tags later */
-    drw_setscheme(drw, scheme[SchemeNorm]);
+    if (statusstale)
+      getstatus();
     tw = TEXTW(stext) - lrpad / 2 + 2; /* 2px extra right padding */
-    drw_text(drw, m->ww - tw - stw, 0, tw, bh, lrpad / 2 - 2, stext, 0);
   }
 
   resizebarwin(m);
-  for (c = m->clients; c; c = c->next) {
-    occ |= c->tags == 255 ? 0 : c->tags;
-    if (c->isurgent)
-      urg |= c->tags;
+  if (m->barbufw != m->ww) {
+    if (m->barbuf)
+      XFreePixmap(dpy, m->barbuf);
+    m->barbuf = XCreatePixmap(dpy, root, m->ww, bh, DefaultDepth(dpy, screen));
+    m->barbufw = m->ww;
+    memset(m->barhash, 0, sizeof m->barhash);
   }
-  x = 0;
-  for (i = 0; i < LENGTH(tags); i++) {
+
+  /* what each part shows, a part is only drawn again once that changes */
+  tagsoccupied(m, &occ, &urg);
+  strcat(strcpy(symbol_and_orei, m->ltsymbol), stack_symbols[m->pertag->attachdir[m->pertag->curtag]]);
+  h[BarTags] = h[BarTitle] = h[BarStatus] = 14695981039346656037ULL;
+  for (x = 0, i = 0; i < LENGTH(tags); i++) {
     /* do not draw vacant tags */
     if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
       continue;
-    w = TEXTW(tags[i]);
-    drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
-    drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
-    x += w;
+    HASHMIX(h[BarTags], i);
+    HASHMIX(h[BarTags], (m->tagset[m->seltags] & 1 << i) | (urg & 1 << i) << 1);
+    x += TEXTW(tags[i]);
   }
-  strcat(strcpy(symbol_and_orei, m->ltsymbol), stack_symbols[m->pertag->attachdir[m->pertag->curtag]]);
-  w = TEXTW(symbol_and_orei);
-  drw_setscheme(drw, scheme[SchemeNorm]);
-  x = drw_text(drw, x, 0, w, bh, lrpad / 2, symbol_and_orei, 0);
-
-  if ((w = m->ww - tw - stw - x) > bh) {
-    if (m->sel) {
+  for (p = symbol_and_orei; *p; p++)
+    HASHMIX(h[BarTags], *p);
+  x += TEXTW(symbol_and_orei);
+  sx = m->ww - tw - stw;
+  w = sx - x;
+  HASHMIX(h[BarTitle], x);
+  HASHMIX(h[BarTitle], w);
+  HASHMIX(h[BarTitle], m == selmon);
+  if ((c = m->sel)) {
+    if (c->titlestale)
+      updatetitle(c);
+    HASHMIX(h[BarTitle], c->win);
+    HASHMIX(h[BarTitle], c->isfloating | c->isfixed << 1 | (STICKY(selmon) == c) << 2
+      | !!(c->tags & m->tagset[m->seltags]) << 3);
+    for (p = c->name; *p; p++)
+      HASHMIX(h[BarTitle], *p);
+  }
+  HASHMIX(h[BarStatus], sx);
+  for (p = tw ? stext : ""; *p; p++)
+    HASHMIX(h[BarStatus], *p);
+  /* a long status runs into the tags, which are drawn over it */
+  redraw = tw && sx < x;
+
+  shared = drw->drawable;
+  drw_setdrawable(drw, m->barbuf);
+  dx0 = m->ww;
+  dx1 = 0;
+  if (tw && (redraw || h[BarStatus] != m->barhash[BarStatus])) {
+    drw_setscheme(drw, scheme[SchemeNorm]);
+    drw_text(drw, sx, 0, tw, bh, lrpad / 2 - 2, stext, 0);
+    dx0 = MIN(dx0, sx);
+    dx1 = MAX(dx1, sx + tw);
+  }
+  if (redraw || h[BarTags] != m->barhash[BarTags]) {
+    for (x = 0, i = 0; i < LENGTH(tags); i++) {
+      if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
+        continue;
+      w = TEXTW(tags[i]);
+      drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
+      drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
+      x += w;
+    }
+    w = TEXTW(symbol_and_orei);
+    drw_setscheme(drw, scheme[SchemeNorm]);
+    x = drw_text(drw, x, 0, w, bh, lrpad / 2, symbol_and_orei, 0);
+    dx0 = 0;
+    dx1 = MAX(dx1, x);
+  }
+  w = sx - x;
+  if (w > 0 && h[BarTitle] != m->barhash[BarTitle]) {
+    if (w > bh && c) {
       drw_setscheme(drw, scheme[m == selmon ? SchemeSel : SchemeNorm]);
-      drw_text(drw, x, 0, w, bh, lrpad / 2, m->sel->name, 0);
-      if (m->sel->isfloating)
-        drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
-      if (selmon->sticky == m->sel)
-        drw_polygon(drw, x + boxs, m->sel->isfloating ? boxs * 2 + boxw : boxs, stickyiconbb.x, stickyiconbb.y, boxw, boxw * stickyiconbb.y / stickyiconbb.x, stickyicon, LENGTH(stickyicon), Nonconvex, m->sel->tags & m->tagset[m->seltags]);
+      drw_text(drw, x, 0, w, bh, lrpad / 2, c->name, 0);
+      if (c->isfloating)
+        drw_rect(drw, x + boxs, boxs, boxw, boxw, c->isfixed, 0);
+      if (STICKY(selmon) == c)
+        drw_polygon(drw, x + boxs, c->isfloating ? boxs * 2 + boxw : boxs, stickyiconbb.x, stickyiconbb.y, boxw, boxw * stickyiconbb.y / stickyiconbb.x, stickyicon, LENGTH(stickyicon), Nonconvex, c->tags & m->tagset[m->seltags]);
     } else {
       drw_setscheme(drw, scheme[SchemeNorm]);
       drw_rect(drw, x, 0, w, bh, 1, 1);
     }
+    dx0 = MIN(dx0, x);
+    dx1 = MAX(dx1, x + w);
+  }
+  memcpy(m->barhash, h, sizeof h);
+  /* only the damaged span goes to the window */
+  dx1 = MIN(dx1, m->ww - stw);
+  if (dx0 < dx1)
+    drw_map(drw, m->barwin, dx0, 0, dx1 - dx0, bh);
+  drw_setdrawable(drw, shared);
+}
+
+/* the wireframe is four override-redirect strips, so nothing has to be
+ * drawn on root and it never touches the client itself */
+void
+drawoutline(int x, int y, int w, int h)
+{
+  XSetWindowAttributes wa = {
+    .override_redirect = True,
+    .background_pixel = scheme[SchemeSel][ColBorder].pixel,
+  };
+  int i, t = MAX(borderpx, 1);
+  int r[4][4] = {
+    { x, y, w, t }, { x, y + h - t, w, t },
+    { x, y, t, h }, { x + w - t, y, t, h },
+  };
+
+  for (i = 0; i < 4; i++) {
+    if (!outline[i])
+      outline[i] = XCreateWindow(dpy, root, 0, 0, 1, 1, 0, DefaultDepth(dpy, screen),
+        CopyFromParent, DefaultVisual(dpy, screen), CWOverrideRedirect|CWBackPixel, &wa);
+    XMoveResizeWindow(dpy, outline[i], r[i][0], r[i][1], MAX(r[i][2], 1), MAX(r[i][3], 1));
+    XMapRaised(dpy, outline[i]);
   }
-  drw_map(drw, m->barwin, 0, 0, m->ww - stw, bh);
 }
 
 void
@@ -1343,9 +2141,10 @@ enternotify(XEvent *e)
   Client *c;
   Monitor *m;
   XCrossingEvent *ev = &e->xcrossing;
-  XEvent xev;
 
-  if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)
+  /* catch windows have no inferiors and take the crossing of an ungrab */
+  if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior)
+  && ev->window != root && !iscatchwin(ev->window))
     return;
   c = wintoclient(ev->window);
   m = c ? c->mon : wintomon(ev->window);
@@ -1356,7 +2155,7 @@ enternotify(XEvent *e)
     return;
   focus(c);
   restack(selmon);
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &xev));
+  drainenter();
 }
 
 void
@@ -1366,6 +2165,9 @@ expose(XEvent *e)
   XExposeEvent *ev = &e->xexpose;
 
   if (ev->count == 0 && (m = wintomon(ev->window))) {
+    /* the bar keeps its last frame, drawbar() only adds what changed */
+    if (ev->window == m->barwin && m->barbuf)
+      XCopyArea(dpy, m->barbuf, m->barwin, drw->gc, 0, 0, m->barbufw, bh, 0, 0);
     drawbar(m);
     if (m == selmon)
       updatesystray();
@@ -1416,10 +2218,11 @@ fakesignal(void)
 void
 focus(Client *c)
 {
+  clickfocus = NULL; /* superseded */
   if (!c || !ISVISIBLE(c)) {
     c = selmon->stack;
     while (c) {
-      if (selmon->sticky == c && selmon->sel != c && !ISFULLSCREEN(c))
+      if (STICKY(selmon) == c && selmon->sel != c && !ISFULLSCREEN(c))
         c = c->snext;
       else if (ISVISIBLE(c))
         break;
@@ -1427,8 +2230,8 @@ focus(Client *c)
         c = c->snext;
     }
   }
-  if (!c && selmon->sticky)
-    c = selmon->sticky;
+  if (!c && STICKY(selmon))
+    c = STICKY(selmon);
   if (selmon->sel && selmon->sel != c)
     unfocus(selmon->sel, 0);
   if (c) {
@@ -1443,13 +2246,154 @@ focus(Client *c)
     setfocus(c);
   } else {
     XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-    XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+    delprop(root, netatom[NetActiveWindow]);
   }
 
   selmon->sel = c;
   drawbars();
 }
 
+/* work deferred by the handlers until the event queue has been drained */
+void
+flushbatch(void)
+{
+  Client *c;
+  int wait;
+
+  if ((c = clickfocus)) {
+    focus(c);
+    restack(selmon);
+  }
+  batchwait = cfgpending ? flushconfigs() : -1;
+  if ((wait = flushtitles()) >= 0 && (batchwait < 0 || wait < batchwait))
+    batchwait = wait;
+  if (drag.active && (wait = flushdrag()) >= 0 && (batchwait < 0 || wait < batchwait))
+    batchwait = wait;
+  if (clientlistdirty)
+    commitclientlist();
+  flushprops();
+}
+
+/* applies queued ConfigureRequests no more often than once per cfginterval
+ * per client, returns the ms until the next one is due or -1 */
+int
+flushconfigs(void)
+{
+  Client *c;
+  Monitor *m;
+  unsigned long long now = getmonotime(), due;
+  int wait = -1;
+
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next) {
+      if (!c->cfgmask)
+        continue;
+      if (now - c->cfgtime < cfginterval * 1000ULL) {
+        due = (c->cfgtime + cfginterval * 1000ULL - now + 999) / 1000;
+        if (wait < 0 || due < (unsigned long long)wait)
+          wait = due;
+        continue;
+      }
+      configurefloating(c);
+      c->cfgmask = 0;
+      cfgpending--;
+    }
+  return wait;
+}
+
+/* acts on the latest pointer of a drag once per frame of the monitor under
+ * it, or once the client painted the last size, returns the ms until the
+ * next update is due or -1 */
+int
+flushdrag(void)
+{
+  Client *c;
+  unsigned long long now = getmonotime(), pace;
+
+  if (!(c = handleclient(drag.c)) || !ISVISIBLE(c)) {
+    dragend(0);
+    return -1;
+  }
+  if (!drag.moved)
+    return -1;
+  if (drag.wire)
+    pace = 0;
+  else if (drag.alarm) /* or the client stopped answering */
+    pace = drag.syncwait ? synctimeout * 1000ULL : 0;
+  else
+    pace = frameinterval(lround(drag.px), lround(drag.py));
+  if (now - drag.lasttime < pace)
+    return (drag.lasttime + pace - now + 999) / 1000;
+  drag.moved = 0;
+  drag.lasttime = now;
+  dragapply(c, 0);
+  return -1;
+}
+
+/* refetches stale titles of selected clients no more often than once per
+ * titleinterval, returns the ms until the next one is due or -1 */
+int
+flushtitles(void)
+{
+  Monitor *m;
+  Client *c;
+  unsigned long long now = getmonotime(), due;
+  int wait = -1;
+
+  for (m = mons; m; m = m->next) {
+    if (!(c = m->sel) || !c->titlestale)
+      continue;
+    if (now - c->titletime < titleinterval * 1000ULL) {
+      due = (c->titletime + titleinterval * 1000ULL - now + 999) / 1000;
+      if (wait < 0 || due < (unsigned long long)wait)
+        wait = due;
+      continue;
+    }
+    drawbar(m);
+  }
+  return wait;
+}
+
+void
+flushprops(void)
+{
+  Prop *p;
+
+  for (p = dirtyprops; p; p = p->dnext) {
+    p->dirty = 0;
+    if (p->newstate == p->state && (p->state != PropSet || p->newval == p->val))
+      continue;
+    if (p->newstate == PropSet)
+      XChangeProperty(dpy, p->win, p->atom, p->type, 32, PropModeReplace,
+        (unsigned char *)&p->newval, 1);
+    else
+      XDeleteProperty(dpy, p->win, p->atom);
+    p->state = p->newstate;
+    p->val = p->newval;
+  }
+  dirtyprops = NULL;
+}
+
+/* drop cached properties of a window that is going away */
+void
+forgetprops(Window w)
+{
+  Prop **pp, **dp, *p;
+
+  for (pp = &props[w % LENGTH(props)]; (p = *pp);) {
+    if (p->win != w) {
+      pp = &p->next;
+      continue;
+    }
+    *pp = p->next;
+    if (p->dirty) {
+      for (dp = &dirtyprops; *dp != p; dp = &(*dp)->dnext);
+      *dp = p->dnext;
+    }
+    free(p);
+  }
+}
+
 /* there are some broken focus acquiring clients needing extra handling */
 void
 focusin(XEvent *e)
@@ -1483,7 +2427,6 @@ focusstack(const Arg *arg)
 {
   int i = stackpos(arg);
   Client *c, *p;
-  XEvent xev;
 
   if (!selmon->sel)
     return;
@@ -1495,7 +2438,41 @@ focusstack(const Arg *arg)
     return;
   focus(c);
   restack(selmon);
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &xev));
+  drainenter();
+}
+
+/* a selected fullscreen client above everything else of its monitor hides
+ * whatever a restack could change */
+int
+fullscreenontop(Monitor *m)
+{
+  Client *c, *f = m->visfull;
+  unsigned int i;
+
+  if (!f || m->sel != f)
+    return 0;
+  /* these get stacked above it, or even take its fullscreen */
+  for (c = m->stack; c; c = c->snext)
+    if (c != f && ISVISIBLE(c) && (c->scratchkey || (c->alwaysontop && c->isfloating)))
+      return 0;
+  for (i = stackorder.n; i-- > 0;) {
+    if (stackorder.wins[i] == f->win)
+      return 1;
+    if ((c = wintoclient(stackorder.wins[i])) && c->mon == m && ISVISIBLE(c))
+      return 0;
+  }
+  return 0;
+}
+
+/* us between two frames of the monitor at x, y, kept finer than whole ms
+ * so high rates pace true; paces interactive moves */
+unsigned long long
+frameinterval(int x, int y)
+{
+  Monitor *m = recttomon(x, y, 1, 1);
+  int hz = refreshrate ? refreshrate : m->refresh ? m->refresh : 60;
+
+  return 1000000ULL / MAX(hz, 1);
 }
 
 Atom
@@ -1521,6 +2498,15 @@ getatomprop(Client *c, Atom prop)
   return atom;
 }
 
+unsigned long long
+getmonotime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
 int
 getrootptr(int *x, int *y)
 {
@@ -1549,6 +2535,14 @@ getstate(Window w)
   return result;
 }
 
+void
+getstatus(void)
+{
+  statusstale = 0;
+  if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
+    strcpy(stext, "dwm-"VERSION);
+}
+
 unsigned int
 getsystraywidth()
 {
@@ -1584,25 +2578,28 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
   return 1;
 }
 
+/* numlockmask is only refreshed on MappingNotify, and the grabs are queued
+ * on the xcb connection without waiting for replies. */
 void
 grabbuttons(Client *c, int focused)
 {
-  updatenumlockmask();
-  {
-    unsigned int i, j;
-    unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-    XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-    if (!focused)
-      XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
-        BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
-    for (i = 0; i < LENGTH(buttons); i++)
-      if (buttons[i].click == ClkClientWin)
-        for (j = 0; j < LENGTH(modifiers); j++)
-          XGrabButton(dpy, buttons[i].button,
-            buttons[i].mask | modifiers[j],
-            c->win, False, BUTTONMASK,
-            GrabModeAsync, GrabModeSync, None, None);
-  }
+  unsigned int i, j;
+  unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+  int state = focused ? GrabFocused : GrabUnfocused;
+
+  if (c->grabstate == state)
+    return;
+  c->grabstate = state;
+  xcb_ungrab_button(xcon, XCB_BUTTON_INDEX_ANY, c->win, XCB_MOD_MASK_ANY);
+  if (!focused)
+    xcb_grab_button(xcon, 0, c->win, BUTTONMASK, XCB_GRAB_MODE_SYNC,
+      XCB_GRAB_MODE_SYNC, XCB_NONE, XCB_NONE, XCB_BUTTON_INDEX_ANY, XCB_MOD_MASK_ANY);
+  for (i = 0; i < LENGTH(buttons); i++)
+    if (buttons[i].click == ClkClientWin)
+      for (j = 0; j < LENGTH(modifiers); j++)
+        xcb_grab_button(xcon, 0, c->win, BUTTONMASK, XCB_GRAB_MODE_ASYNC,
+          XCB_GRAB_MODE_SYNC, XCB_NONE, XCB_NONE, buttons[i].button,
+          buttons[i].mask | modifiers[j]);
 }
 
 void
@@ -1634,32 +2631,66 @@ grid(Monitor *m)
   }
 }
 
+Client *
+handleclient(Handle h)
+{
+  if (!h.c)
+    return NULL;
+  if (h.c->gen != h.gen) {
+    nstale++;
+    return NULL;
+  }
+  return h.c;
+}
+
+/* whether w has prop at all, asks the server */
+int
+haswinprop(Window w, Atom prop)
+{
+  int di;
+  unsigned long dl;
+  unsigned char *p = NULL;
+  Atom da;
+
+  if (XGetWindowProperty(dpy, w, prop, 0L, 1L, False, AnyPropertyType,
+    &da, &di, &dl, &dl, &p) != Success || !p)
+    return 0;
+  XFree(p);
+  return 1;
+}
+
+void
+hideoutline(void)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    if (outline[i])
+      XUnmapWindow(dpy, outline[i]);
+}
+
 void
 grabkeys(void)
 {
-  updatenumlockmask();
-  {
-    unsigned int i, j, k;
-    unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-    int start, end, skip;
-    KeySym *syms;
-
-    XUngrabKey(dpy, AnyKey, AnyModifier, root);
-    XDisplayKeycodes(dpy, &start, &end);
-    syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
-    if (!syms)
-      return;
-    for (k = start; k <= end; k++)
-      for (i = 0; i < LENGTH(keys); i++)
-        /* skip modifier codes, we do that ourselves */
-        if (keys[i].keysym == syms[(k - start) * skip])
-          for (j = 0; j < LENGTH(modifiers); j++)
-            XGrabKey(dpy, k,
-               keys[i].mod | modifiers[j],
-               root, True,
-               GrabModeAsync, GrabModeAsync);
-    XFree(syms);
-  }
+  unsigned int i, j, k;
+  unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+  int start, end, skip;
+  KeySym *syms;
+
+  xcb_ungrab_key(xcon, XCB_GRAB_ANY, root, XCB_MOD_MASK_ANY);
+  XDisplayKeycodes(dpy, &start, &end);
+  syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
+  if (!syms)
+    return;
+  for (k = start; k <= end; k++)
+    for (i = 0; i < LENGTH(keys); i++)
+      /* skip modifier codes, we do that ourselves */
+      if (keys[i].keysym == syms[(k - start) * skip])
+        for (j = 0; j < LENGTH(modifiers); j++)
+          xcb_grab_key(xcon, 1, root, keys[i].mod | modifiers[j], k,
+            XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+  XFree(syms);
+  xcb_flush(xcon);
 }
 
 void
@@ -1676,6 +2707,87 @@ incnmaster(const Arg *arg)
   arrange(selmon);
 }
 
+int
+iscatchwin(Window w)
+{
+  Monitor *m;
+
+  for (m = mons; m; m = m->next)
+    if (w == m->catchwin)
+      return 1;
+  return 0;
+}
+
+/* input may only overtake queued events that cannot change focus, the
+ * selection or the keymap, *arg is set at the first one that can */
+Bool
+isinput(Display *dpy, XEvent *ev, XPointer arg)
+{
+  int *blocked = (int *)arg;
+
+  switch (ev->type) {
+  case KeyPress:
+  case ButtonPress:
+  case ButtonRelease:
+    return !*blocked;
+  case PropertyNotify:
+  case ConfigureRequest:
+  case MotionNotify:
+  case Expose:
+    return False;
+  }
+  *blocked = 1;
+  return False;
+}
+
+/* the slot counting the queued events that share the key of ev, which is
+ * the window for MotionNotify and window, atom and state for PropertyNotify;
+ * NULL if there is none and add is not set, or the table is full */
+Pending *
+pendingslot(XEvent *ev, int add)
+{
+  Atom atom = ev->type == PropertyNotify ? ev->xproperty.atom : None;
+  int state = ev->type == PropertyNotify ? ev->xproperty.state : 0;
+  unsigned long long h = 14695981039346656037ULL;
+  unsigned int i, n;
+  Pending *p;
+
+  HASHMIX(h, ev->type);
+  HASHMIX(h, ev->xany.window);
+  HASHMIX(h, atom);
+  HASHMIX(h, state);
+  for (i = h & (PENDINGSLOTS - 1), n = 0; n < PENDINGSLOTS; i = (i + 1) & (PENDINGSLOTS - 1), n++) {
+    p = &pending[i];
+    if (p->gen != pendinggen) {
+      if (!add)
+        return NULL;
+      p->gen = pendinggen;
+      p->type = ev->type;
+      p->state = state;
+      p->win = ev->xany.window;
+      p->atom = atom;
+      p->n = 0;
+      return p;
+    }
+    if (p->type == ev->type && p->win == ev->xany.window
+    && p->atom == atom && p->state == state)
+      return p;
+  }
+  return NULL;
+}
+
+/* never removes anything, counts the coalescable events in one pass */
+Bool
+countqueued(Display *dpy, XEvent *ev, XPointer arg)
+{
+  Pending *p;
+
+  if ((ev->type == PropertyNotify || ev->type == MotionNotify)
+  && (p = pendingslot(ev, 1)))
+    p->n++;
+  return False;
+}
+
 #ifdef XINERAMA
 static int
 isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
@@ -1688,6 +2800,41 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 }
 #endif /* XINERAMA */
 
+/* covers everything arrangemon() and resizeclient() look at, except size
+ * hints, whose change clears the cached hashes instead */
+unsigned long long
+layouthash(Monitor *m)
+{
+  Client *c;
+  unsigned long long h = 14695981039346656037ULL;
+  long v[] = {
+    (long)m->lt[m->sellt], (long)(m->mfact * 10000), m->nmaster,
+    m->wx, m->wy, m->ww, m->wh, selmon->ww, selmon->wh, selmon->topbar
+  };
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(v); i++)
+    HASHMIX(h, v[i]);
+  for (c = m->clients; c; c = c->next) {
+    if (!ISVISIBLE(c))
+      continue;
+    HASHMIX(h, c->win);
+    HASHMIX(h, c->isfloating);
+    HASHMIX(h, c->fstag);
+    HASHMIX(h, (long)(c->cfact * 10000));
+    HASHMIX(h, c->bw);
+    HASHMIX(h, c->x);
+    HASHMIX(h, c->y);
+    HASHMIX(h, c->w);
+    HASHMIX(h, c->h);
+  }
+  /* fibonacci() and friends pick clients by focus order */
+  for (c = m->stack; c; c = c->snext)
+    if (!c->isfloating && ISVISIBLE(c))
+      HASHMIX(h, c->win);
+  return h;
+}
+
 void
 keypress(XEvent *e)
 {
@@ -1707,7 +2854,7 @@ keypress(XEvent *e)
 void
 killclient(const Arg *arg)
 {
-  if(!selmon->sel || (selmon->sel->scratchkey && !selmon->sel->swallowing))
+  if(!selmon->sel || (selmon->sel->scratchkey && !SWALLOWED(selmon->sel)))
     return;
   if (!sendevent(selmon->sel->win, wmatom[WMDelete], NoEventMask, wmatom[WMDelete], CurrentTime, 0, 0, 0)) {
     XGrabServer(dpy);
@@ -1726,12 +2873,12 @@ manage(Window w, XWindowAttributes *wa)
   Client *c, *t = NULL, *term = NULL;
   Window trans = None;
   XWindowChanges wc;
-  XEvent xev;
 
-  c = ecalloc(1, sizeof(Client));
+  c = clientalloc();
   c->win = w;
   c->pid = winpid(w);
   updatetitle(c);
+  updatewinatoms(c, 1, 1);
   if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
     c->mon = t->mon;
     c->tags = t->tags;
@@ -1741,16 +2888,13 @@ manage(Window w, XWindowAttributes *wa)
     applyrules(c);
     term = termforwin(c);
   }
+  setvisible(c);
   setclientgeo(c, wa);
   wc.border_width = c->bw;
   XConfigureWindow(dpy, w, CWBorderWidth, &wc);
   XSetWindowBorder(dpy, w, scheme[SchemeNorm][ColBorder].pixel);
   configure(c); /* propagates border_width, if size doesn't change */
-  if (getatomprop(c, netatom[NetWMState]) == netatom[NetWMStateAbove] ||
-    (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeSplash]) ||
-    (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeToolbar]) ||
-    (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeDialog]) ||
-    (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeUtility]))
+  if ((c->wstate & NETBIT(NetWMStateAbove)) || (c->wtype & ONTOPTYPES))
     c->alwaysontop = 1;
   updatesizehints(c);
   updatewmhints(c);
@@ -1758,18 +2902,19 @@ manage(Window w, XWindowAttributes *wa)
   grabbuttons(c, 0);
   if (!c->isfloating)
     c->isfloating = c->oldstate = trans != None || c->isfixed;
+  /* a client that knows its opaque region knows better */
+  c->ownopaque = tiledopaque && !haswinprop(w, netatom[NetWMOpaqueRegion]);
   attach(c);
   attachstack(c);
-  XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-    (unsigned char *) &(c->win), 1);
-  XChangeProperty(dpy, root, netatom[NetClientListStacking], XA_WINDOW, 32, PropModePrepend,
-    (unsigned char *) &(c->win), 1);
+  stackplace(c->win, None, Above);
+  updateclientlist();
   XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
+  setsentpos(c, c->x + 2 * sw, c->y);
   setclientstate(c, NormalState);
   if (c->mon == selmon)
     unfocusmon(selmon);
-  if (c->mon->pertag->fullscreens[c->mon->pertag->curtag] && !c->alwaysontop)
-    focus(c->mon->pertag->fullscreens[c->mon->pertag->curtag]);
+  if (FULLSCREEN(c->mon, c->mon->pertag->curtag) && !c->alwaysontop)
+    focus(FULLSCREEN(c->mon, c->mon->pertag->curtag));
   if (c->scratchkey)
     focus(c);
   arrange(c->mon);
@@ -1778,17 +2923,32 @@ manage(Window w, XWindowAttributes *wa)
     swallow(term, c);
   focus(NULL);
   setdesktopforclient(c, c->mon->pertag->curtag);
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &xev));
+  drainenter();
 }
 
 void
 mappingnotify(XEvent *e)
 {
   XMappingEvent *ev = &e->xmapping;
+  unsigned int oldmask = numlockmask;
+  int state;
+  Client *c;
+  Monitor *m;
 
   XRefreshKeyboardMapping(ev);
-  if (ev->request == MappingKeyboard)
-    grabkeys();
+  if (ev->request != MappingKeyboard && ev->request != MappingModifier)
+    return;
+  updatenumlockmask();
+  grabkeys();
+  if (numlockmask == oldmask)
+    return;
+  /* button grabs carry the numlock modifier too, redo them */
+  for (m = mons; m; m = m->next)
+    for (c = m->clients; c; c = c->next)
+      if ((state = c->grabstate) != GrabUnknown) {
+        c->grabstate = GrabUnknown;
+        grabbuttons(c, state == GrabFocused);
+      }
 }
 
 void
@@ -1827,81 +2987,25 @@ monocle(Monitor *m)
     resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
 }
 
-void
-motionnotify(XEvent *e)
-{
-  static Monitor *mon = NULL;
-  Monitor *m;
-  XMotionEvent *ev = &e->xmotion;
-
-  if (ev->window != root)
-    return;
-  if ((m = recttomon(ev->x_root, ev->y_root, 1, 1)) != mon && mon) {
-    unfocus(selmon->sel, 1);
-    selmon = m;
-    focus(NULL);
-  }
-  mon = m;
-}
-
 void
 movemouse(const Arg *arg)
 {
-  int x, y, ocx, ocy, nx, ny;
+  int x, y;
   Client *c;
-  Monitor *m;
-  XEvent ev;
-  Time lasttime = 0;
 
-  if (!(c = selmon->sel))
+  if (drag.active || !(c = selmon->sel))
     return;
   if (ISFULLSCREEN(c)) /* no support moving fullscreen windows by mouse */
     return;
   restack(selmon);
-  ocx = c->x;
-  ocy = c->y;
-  if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-    None, cursor[CurMove]->cursor, CurrentTime) != GrabSuccess)
+  if (!dragstart(c, 0, arg->i || c->wireframe, cursor[CurMove]->cursor))
     return;
-  if (!getrootptr(&x, &y))
+  if (!getrootptr(&x, &y)) {
+    dragend(0);
     return;
-  do {
-    XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
-    switch(ev.type) {
-    case ConfigureRequest:
-    case Expose:
-    case MapRequest:
-      handler[ev.type](&ev);
-      break;
-    case MotionNotify:
-      if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-        continue;
-      lasttime = ev.xmotion.time;
-
-      nx = ocx + (ev.xmotion.x - x);
-      ny = ocy + (ev.xmotion.y - y);
-      if (abs(selmon->wx - nx) < snap)
-        nx = selmon->wx;
-      else if (abs((selmon->wx + selmon->ww) - (nx + WIDTH(c))) < snap)
-        nx = selmon->wx + selmon->ww - WIDTH(c);
-      if (abs(selmon->wy - ny) < snap)
-        ny = selmon->wy;
-      else if (abs((selmon->wy + selmon->wh) - (ny + HEIGHT(c))) < snap)
-        ny = selmon->wy + selmon->wh - HEIGHT(c);
-      if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
-      && (abs(nx - c->x) > snap || abs(ny - c->y) > snap))
-        togglefloating(NULL);
-      if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
-        resize(c, nx, ny, c->w, c->h, 1);
-      break;
-    }
-  } while (ev.type != ButtonRelease);
-  XUngrabPointer(dpy, CurrentTime);
-  if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
-    sendmon(c, m);
-    selmon = m;
-    focus(NULL);
   }
+  drag.px = drag.ptrx = x;
+  drag.py = drag.ptry = y;
 }
 
 Client *
@@ -1954,6 +3058,11 @@ propertynotify(XEvent *e)
     if (!fakesignal())
       updatestatus();
   }
+  else if (ev->atom == netatom[NetWMOpaqueRegion]) {
+    /* deletions count too, dwm's own writes are told apart by value */
+    if ((c = wintoclient(ev->window)))
+      updateopaqueowner(c);
+  }
   else if (ev->state == PropertyDelete)
     return; /* ignore */
   else if ((c = wintoclient(ev->window))) {
@@ -1961,34 +3070,56 @@ propertynotify(XEvent *e)
     default: break;
     case XA_WM_TRANSIENT_FOR:
       if (!c->isfloating && (XGetTransientForHint(dpy, c->win, &trans)) &&
-        (c->isfloating = (wintoclient(trans)) != NULL))
+        (c->isfloating = (wintoclient(trans)) != NULL)) {
+        reindex(c);
         arrange(c->mon);
+      }
       break;
     case XA_WM_NORMAL_HINTS:
       c->hintsvalid = 0;
+      memset(c->mon->pertag->lthash, 0, sizeof c->mon->pertag->lthash);
       break;
     case XA_WM_HINTS:
       updatewmhints(c);
       drawbars();
       break;
     }
-    if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-      updatetitle(c);
-      if (c == c->mon->sel)
-        drawbar(c->mon);
-    }
+    if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName])
+      c->titlestale = 1;
+    if (ev->atom == netatom[NetWMState])
+      updatewinatoms(c, 0, 1);
     if (ev->atom == netatom[NetWMWindowType]) {
-      if ((getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeSplash]) ||
-      (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeToolbar]) ||
-      (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeDialog]) ||
-      (getatomprop(c, netatom[NetWMWindowType]) == netatom[NetWMWindowTypeUtility]))
+      updatewinatoms(c, 1, 0);
+      if (c->wtype & ONTOPTYPES)
         c->alwaysontop = 1;
-      if (getatomprop(c, netatom[NetWMState]) == netatom[NetWMFullscreen])
+      if (c->wstate & NETBIT(NetWMFullscreen))
         setfullscreen(c, 1, 1);
     }
   }
 }
 
+Prop *
+propentry(Window w, Atom atom)
+{
+  Prop *p, **head = &props[w % LENGTH(props)];
+
+  for (p = *head; p && (p->win != w || p->atom != atom); p = p->next);
+  if (!p) {
+    p = ecalloc(1, sizeof(Prop));
+    p->win = w;
+    p->atom = atom;
+    p->state = PropUnknown;
+    p->next = *head;
+    *head = p;
+  }
+  if (!p->dirty) {
+    p->dirty = 1;
+    p->dnext = dirtyprops;
+    dirtyprops = p;
+  }
+  return p;
+}
+
 void
 pushstack(const Arg *arg)
 {
@@ -2009,12 +3140,20 @@ pushstack(const Arg *arg)
     if (!c || (!c->next && !sel->next))
       return;
     detach(sel);
-    sel->next = c->next;
-    c->next = sel;
+    attachafter(sel, c);
   }
   arrange(selmon);
 }
 
+void
+reindex(Client *c)
+{
+  if (!c->indexed)
+    return;
+  tagindex(c, 0);
+  tagindex(c, 1);
+}
+
 void
 quit(const Arg *arg)
 {
@@ -2068,7 +3207,7 @@ removesystrayicon(Client *i)
   for (ii = &systray->icons; *ii && *ii != i; ii = &(*ii)->next);
   if (ii)
     *ii = i->next;
-  free(i);
+  clientfree(i);
 }
 
 void
@@ -2085,6 +3224,10 @@ resizebarwin(Monitor *m)
   if (showsystray && m == systraytomon(m) && !systrayonleft)
     w -= getsystraywidth();
   XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, w, bh);
+  if (w != m->opaquew) {
+    setopaqueregion(m->barwin, w, bh);
+    m->opaquew = w;
+  }
 }
 
 void
@@ -2148,86 +3291,47 @@ resizeclient(Client *c, int x, int y, int w, int h)
     c->sfh = c->h;
   }
 
+  updateopaque(c);
+  /* nobody can see it, showhide() sends the geometry once it is shown */
+  if (!ISVISIBLE(c)) {
+    c->nextbw = wc.border_width;
+    c->needresize = 1;
+    return;
+  }
+  c->needresize = 0;
   XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
+  setsentpos(c, wc.x, wc.y);
   configure(c);
-  XSync(dpy, False);
 }
 
 void
 resizemouse(const Arg *arg)
 {
-  int ocx, ocy, nw, nh;
-  int ocx2, ocy2, nx, ny;
-  Client *c;
-  Monitor *m;
-  XEvent ev;
-  int horizcorner, vertcorner;
-  int di;
+  int nx, ny, di;
   unsigned int dui;
   Window dummy;
-  Time lasttime = 0;
+  Client *c;
 
-  if (!(c = selmon->sel))
+  if (drag.active || !(c = selmon->sel))
     return;
   if (ISFULLSCREEN(c)) /* no support resizing fullscreen windows by mouse */
     return;
   restack(selmon);
-  ocx = c->x;
-  ocy = c->y;
-  ocx2 = c->x + c->w;
-  ocy2 = c->y + c->h;
-  if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-    None, cursor[CurResize]->cursor, CurrentTime) != GrabSuccess)
+  if (!dragstart(c, 1, arg->i || c->wireframe, cursor[CurResize]->cursor))
     return;
-  if (!XQueryPointer (dpy, c->win, &dummy, &dummy, &di, &di, &nx, &ny, &dui))
+  if (!XQueryPointer (dpy, c->win, &dummy, &dummy, &di, &di, &nx, &ny, &dui)) {
+    dragend(0);
     return;
-  horizcorner = nx < c->w / 2;
-  vertcorner  = ny < c->h / 2;
-  XWarpPointer (dpy, None, c->win, 0, 0, 0, 0,
-      horizcorner ? (-c->bw) : (c->w + c->bw -1),
-      vertcorner  ? (-c->bw) : (c->h + c->bw -1));
-  do {
-    XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
-    switch(ev.type) {
-    case ConfigureRequest:
-    case Expose:
-    case MapRequest:
-      handler[ev.type](&ev);
-      break;
-    case MotionNotify:
-      if ((ev.xmotion.time - lasttime) <= (1000 / 60))
-        continue;
-      lasttime = ev.xmotion.time;
-
-      nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
-      nh = MAX(ev.xmotion.y - ocy - 2 * c->bw + 1, 1);
-      nx = horizcorner ? ev.xmotion.x : c->x;
-      ny = vertcorner ? ev.xmotion.y : c->y;
-      nw = MAX(horizcorner ? (ocx2 - nx) : (ev.xmotion.x - ocx - 2 * c->bw + 1), 1);
-      nh = MAX(vertcorner ? (ocy2 - ny) : (ev.xmotion.y - ocy - 2 * c->bw + 1), 1);
-
-      if (c->mon->wx + nw >= selmon->wx && c->mon->wx + nw <= selmon->wx + selmon->ww
-      && c->mon->wy + nh >= selmon->wy && c->mon->wy + nh <= selmon->wy + selmon->wh)
-      {
-        if (!c->isfloating && selmon->lt[selmon->sellt]->arrange
-        && (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
-          togglefloating(NULL);
-      }
-      if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
-        resize(c, nx, ny, nw, nh, 1);
-      break;
-    }
-  } while (ev.type != ButtonRelease);
-  XWarpPointer(dpy, None, c->win, 0, 0, 0, 0,
-          horizcorner ? (-c->bw) : (c->w + c->bw - 1),
-          vertcorner ? (-c->bw) : (c->h + c->bw - 1));
-  XUngrabPointer(dpy, CurrentTime);
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
-  if ((m = recttomon(c->x, c->y, c->w, c->h)) != selmon) {
-    sendmon(c, m);
-    selmon = m;
-    focus(NULL);
   }
+  drag.horizcorner = nx < c->w / 2;
+  drag.vertcorner  = ny < c->h / 2;
+  /* clients speaking _NET_WM_SYNC_REQUEST set the pace themselves */
+  drag.alarm = drag.wire ? None : syncalarm(c, &drag.syncvalue);
+  drag.px = c->x + (drag.horizcorner ? 0 : c->w + 2 * c->bw - 1);
+  drag.py = c->y + (drag.vertcorner ? 0 : c->h + 2 * c->bw - 1);
+  XWarpPointer (dpy, None, c->win, 0, 0, 0, 0,
+      drag.horizcorner ? (-c->bw) : (c->w + c->bw -1),
+      drag.vertcorner  ? (-c->bw) : (c->h + c->bw -1));
 }
 
 void
@@ -2256,25 +3360,114 @@ resetfact(const Arg *arg)
 void
 restack(Monitor *m)
 {
-  XEvent ev;
-
   drawbar(m);
-  if (!m->sel)
+  if (!m->sel || fullscreenontop(m))
     return;
   configuremonlayout(m);
   XSync(dpy, False);
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+  drainenter();
+}
+
+/* hands the clients of a monitor that went away to the first one, a
+ * RandR monitor leaves its pertag state behind for when it comes back */
+void
+retiremon(Monitor *m)
+{
+  Client *c;
+  Parked *p;
+
+  while ((c = m->clients)) {
+    detach(c);
+    setfullscreen(c, 0, 1);
+    detachstack(c);
+    c->mon = mons;
+    attach(c);
+    attachstack(c);
+    setvisible(c);
+    mons->relayout = 1;
+  }
+  if (m == selmon)
+    selmon = mons;
+  if (m->output[0]) {
+    p = ecalloc(1, sizeof(Parked));
+    strncpy(p->output, m->output, sizeof p->output - 1);
+    p->tagset[0] = m->tagset[0];
+    p->tagset[1] = m->tagset[1];
+    p->seltags = m->seltags;
+    p->topbar = m->topbar;
+    p->pertag = m->pertag;
+    m->pertag = NULL;
+    p->next = parked;
+    parked = p;
+  }
+  cleanupmon(m);
+}
+
+#ifdef XRANDR
+void
+rrscreenchange(XEvent *e)
+{
+  XRRUpdateConfiguration(e);
+  /* outputs are switched one by one, one rescan covers the whole burst */
+  while (XCheckTypedEvent(dpy, rrevbase + RRScreenChangeNotify, e))
+    XRRUpdateConfiguration(e);
+  updatemons(DisplayWidth(dpy, screen), DisplayHeight(dpy, screen));
 }
+#endif /* XRANDR */
 
 void
 run(void)
 {
   XEvent ev;
+  struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+  unsigned long long readtime, backlog, t;
+  int blocked;
+  Pending *p;
+
   /* main event loop */
+  flushbatch();
   XSync(dpy, False);
-  while (running && !XNextEvent(dpy, &ev))
-    if (handler[ev.type])
-      handler[ev.type](&ev); /* call handler */
+  backlog = getmonotime();
+  while (running) {
+    /* block only when there is nothing left, otherwise just pick up
+     * whatever arrived in the meantime */
+    if (!XEventsQueued(dpy, QueuedAlready)) {
+      /* throttled updates still have to go out while idle */
+      while (batchwait >= 0 && !XPending(dpy)) {
+        poll(&pfd, 1, batchwait);
+        if (!XPending(dpy))
+          flushbatch();
+      }
+      XPeekEvent(dpy, &ev);
+      backlog = getmonotime();
+    } else
+      XEventsQueued(dpy, QueuedAfterReading);
+    readtime = getmonotime();
+    /* input is served first, ahead of whatever cannot affect it */
+    blocked = 0;
+    while (running && XCheckIfEvent(dpy, &ev, isinput, (XPointer)&blocked)) {
+      dispatch(&ev, EvInput, readtime);
+      blocked = 0;
+    }
+    /* the rest in arrival order, until the slice is used up and input is
+     * polled again; a PropertyNotify or MotionNotify with a later one of
+     * the same key counted in the queue is skipped */
+    pendinggen++;
+    if (XEventsQueued(dpy, QueuedAlready) > 1)
+      XCheckIfEvent(dpy, &ev, countqueued, NULL);
+    for (t = getmonotime(); running && XEventsQueued(dpy, QueuedAlready)
+    && getmonotime() - t < eventslice * 1000;) {
+      XNextEvent(dpy, &ev);
+      if ((ev.type == PropertyNotify || ev.type == MotionNotify)
+      && (p = pendingslot(&ev, 0)) && p->n && --p->n) {
+        ncoalesced++;
+        continue;
+      }
+      dispatch(&ev, ev.type == KeyPress || ev.type == ButtonPress
+        || ev.type == ButtonRelease ? EvInput : EvOther, backlog);
+    }
+    flushbatch();
+  }
 }
 
 void
@@ -2398,13 +3591,15 @@ sendmon(Client *c, Monitor *m)
   c->tags = m->tagset[m->seltags]; /* assign tags of target monitor */
   for (i = 0; !(c->tags & 1 << i); i++);
   setdesktopforclient(c, i+1);
-  if (selmon->sticky)
-    selmon->sticky = NULL;
+  if (STICKY(selmon))
+    selmon->sticky = clienthandle(NULL);
   attach(c);
   attachstack(c);
-  if (m->pertag->fullscreens[m->pertag->curtag] && !c->alwaysontop) {
-    detachstack(m->pertag->fullscreens[m->pertag->curtag]);
-    attachstack(m->pertag->fullscreens[m->pertag->curtag]);
+  updatevisible(selmon);
+  setvisible(c);
+  if (FULLSCREEN(m, m->pertag->curtag) && !c->alwaysontop) {
+    detachstack(FULLSCREEN(m, m->pertag->curtag));
+    attachstack(FULLSCREEN(m, m->pertag->curtag));
   }
   if (fs)
     setfullscreen(c, 1, 0);
@@ -2436,6 +3631,23 @@ setcfact(const Arg *arg)
   arrange(selmon);
 }
 
+/* lets the compositor unredirect a fullscreen client, unless the client
+ * has its own say in _NET_WM_BYPASS_COMPOSITOR */
+void
+setbypass(Client *c, int bypass)
+{
+  if (!bypass) {
+    if (c->ownbypass)
+      delprop(c->win, netatom[NetWMBypassCompositor]);
+    c->ownbypass = 0;
+    return;
+  }
+  if (c->ownbypass || haswinprop(c->win, netatom[NetWMBypassCompositor]))
+    return;
+  setprop(c->win, netatom[NetWMBypassCompositor], XA_CARDINAL, 1);
+  c->ownbypass = 1;
+}
+
 void
 setclientstate(Client *c, long state)
 {
@@ -2448,15 +3660,13 @@ setclientstate(Client *c, long state)
 void
 setcurrentdesktop(void)
 {
-  long data[] = { 0 };
-  XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)data, 1);
+  setprop(root, netatom[NetCurrentDesktop], XA_CARDINAL, 0);
 }
 
 void
 setdesktopforclient(Client *c, int tag)
 {
-  long data[] = { tag };
-  XChangeProperty(dpy, c->win, netatom[NetCurrentDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)data, 1);
+  setprop(c->win, netatom[NetCurrentDesktop], XA_CARDINAL, tag);
 }
 
 void
@@ -2501,6 +3711,41 @@ sendevent(Window w, Atom proto, int mask, long d0, long d1, long d2, long d3, lo
   return exists;
 }
 
+/* tells compositors the w x h at the origin of win needs no blending,
+ * an empty size takes that back */
+void
+setopaqueregion(Window win, unsigned int w, unsigned int h)
+{
+  long r[4] = { 0, 0, w, h };
+
+  if (w && h)
+    XChangeProperty(dpy, win, netatom[NetWMOpaqueRegion], XA_CARDINAL, 32,
+      PropModeReplace, (unsigned char *)r, 4);
+  else
+    XDeleteProperty(dpy, win, netatom[NetWMOpaqueRegion]);
+}
+
+/* queue a single item property write, redundant ones are dropped by
+ * flushprops() at the end of the event batch */
+void
+setprop(Window w, Atom atom, Atom type, long val)
+{
+  Prop *p = propentry(w, atom);
+
+  p->newstate = PropSet;
+  p->newval = val;
+  if (p->type != type) {
+    p->type = type;
+    p->state = PropUnknown;
+  }
+}
+
+void
+delprop(Window w, Atom atom)
+{
+  propentry(w, atom)->newstate = PropDeleted;
+}
+
 void
 setnumdesktops(void)
 {
@@ -2514,10 +3759,14 @@ sethidden(Client *c, int hidden)
 {
   if (hidden) {
     c->tags = 0;
+    setvisible(c);
+    reindex(c);
     setclientstate(c, WithdrawnState);
     focus(NULL);
   } else {
     c->tags = selmon->tagset[selmon->seltags];
+    setvisible(c);
+    reindex(c);
     setdesktopforclient(c, c->mon->pertag->curtag);
     setclientstate(c, NormalState);
     focus(c);
@@ -2529,9 +3778,7 @@ setfocus(Client *c)
 {
   if (!c->neverfocus) {
     XSetInputFocus(dpy, c->win, RevertToPointerRoot, CurrentTime);
-    XChangeProperty(dpy, root, netatom[NetActiveWindow],
-      XA_WINDOW, 32, PropModeReplace,
-      (unsigned char *) &(c->win), 1);
+    setprop(root, netatom[NetActiveWindow], XA_WINDOW, c->win);
   }
   if (c->ignoremoverequest)
     setclientstate(c, NormalState);
@@ -2610,18 +3857,22 @@ void
 setfullscreenontag(Client *c, int fullscreen, int tag, int f)
 {
   if (fullscreen && !ISFULLSCREEN(c)) {
-    if(c->mon->pertag->fullscreens[tag])
-      setfullscreen(c->mon->pertag->fullscreens[tag], 0, f);
+    if(FULLSCREEN(c->mon, tag))
+      setfullscreen(FULLSCREEN(c->mon, tag), 0, f);
     XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
       PropModeReplace, (unsigned char*)&netatom[NetWMFullscreen], 1);
-    c->mon->pertag->fullscreens[tag] = c;
+    c->wstate = NETBIT(NetWMFullscreen);
+    c->mon->pertag->fullscreens[tag] = clienthandle(c);
     c->oldstate = c->isfloating;
     c->oldbw = c->bw;
     c->bw = 0;
     c->isfloating = 1;
     c->fstag = tag;
+    reindex(c);
+    updatevisible(c->mon);
     resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
     raiseclient(c);
+    setbypass(c, 1);
     if (f)
       focus(c);
     hidebar(c->mon, tag);
@@ -2629,15 +3880,19 @@ setfullscreenontag(Client *c, int fullscreen, int tag, int f)
   } else if (!fullscreen && ISFULLSCREEN(c)) {
     XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
       PropModeReplace, (unsigned char*)0, 0);
-    c->mon->pertag->fullscreens[tag] = NULL;
+    c->wstate = 0;
+    c->mon->pertag->fullscreens[tag] = clienthandle(NULL);
     c->isfloating = c->oldstate;
+    reindex(c);
     c->bw = c->oldbw;
     c->x = c->oldx;
     c->y = c->oldy;
     c->w = c->oldw;
     c->h = c->oldh;
     c->fstag = -1;
+    updatevisible(c->mon);
     resizeclient(c, c->x, c->y, c->w, c->h);
+    setbypass(c, 0);
     if (f)
       focus(NULL);
     displaybar(c->mon, tag);
@@ -2703,12 +3958,26 @@ setmfact(const Arg *arg)
   arrange(selmon);
 }
 
+void
+setvisible(Client *c)
+{
+  Monitor *m = c->mon;
+
+  c->isvisible = m && ((c->tags & m->vistags)
+    || (m->vissticky == c && (!m->visfull || ISFULLSCREEN(c))));
+}
+
 void
 setup(void)
 {
   int i;
+#ifdef XRANDR
+  int rrmajor, rrminor;
+#endif /* XRANDR */
+#ifdef XINPUT
+  int ximajor = 2, ximinor = 0;
+#endif /* XINPUT */
   XSetWindowAttributes wa;
-  Atom utf8string;
   struct sigaction sa;
 
   /* do not transform children into zombies when they terminate */
@@ -2725,12 +3994,23 @@ setup(void)
   sw = DisplayWidth(dpy, screen);
   sh = DisplayHeight(dpy, screen);
   root = RootWindow(dpy, screen);
-  drw = drw_create(dpy, screen, root, sw, sh);
+  drw = drw_create(dpy, screen, root, 1, 1); /* bars draw into their own barbuf */
   if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
     die("no fonts could be loaded.");
   lrpad = drw->fonts->h;
   bh = drw->fonts->h + 2;
+#ifdef XRANDR
+  if ((haverandr = XRRQueryExtension(dpy, &rrevbase, &i)
+  && XRRQueryVersion(dpy, &rrmajor, &rrminor) && (rrmajor > 1 || rrminor >= 5)))
+    XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+#endif /* XRANDR */
   updategeom();
+  updaterefresh();
+  havesync = XSyncQueryExtension(dpy, &syncevbase, &i) && XSyncInitialize(dpy, &i, &i);
+#ifdef XINPUT
+  havexi = XQueryExtension(dpy, "XInputExtension", &xiopcode, &i, &i)
+    && XIQueryVersion(dpy, &ximajor, &ximinor) == Success;
+#endif /* XINPUT */
   /* init atoms */
   utf8string = XInternAtom(dpy, "UTF8_STRING", False);
   wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
@@ -2749,6 +4029,10 @@ setup(void)
   netatom[NetWMCheck] = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
   netatom[NetWMFullscreen] = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
   netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
+  netatom[NetWMSyncRequest] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+  netatom[NetWMSyncRequestCounter] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+  netatom[NetWMBypassCompositor] = XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False);
+  netatom[NetWMOpaqueRegion] = XInternAtom(dpy, "_NET_WM_OPAQUE_REGION", False);
   netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
   netatom[NetWMWindowTypeUtility] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_UTILITY", False);
   netatom[NetWMWindowTypeToolbar] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_TOOLBAR", False);
@@ -2804,10 +4088,11 @@ setup(void)
   /* select events */
   wa.cursor = cursor[CurNormal]->cursor;
   wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
-    |ButtonPressMask|PointerMotionMask|EnterWindowMask
+    |ButtonPressMask|EnterWindowMask
     |LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
   XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
   XSelectInput(dpy, root, wa.event_mask);
+  updatenumlockmask();
   grabkeys();
   focus(NULL);
 }
@@ -2839,6 +4124,7 @@ seturgent(Client *c, int urg)
   XWMHints *wmh;
 
   c->isurgent = urg;
+  reindex(c);
   if (!(wmh = XGetWMHints(dpy, c->win)))
     return;
   wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
@@ -2847,33 +4133,84 @@ seturgent(Client *c, int urg)
 }
 
 void
-showhide(Client *c)
+setsentpos(Client *c, int x, int y)
 {
-  if (!c)
+  c->sentx = x;
+  c->senty = y;
+  c->possent = 1;
+}
+
+/* moves c->win unless it was last sent to x, y already */
+void
+movewin(Client *c, int x, int y)
+{
+  if (c->possent && c->sentx == x && c->senty == y)
     return;
-  if (ISVISIBLE(c)) {
-    /* show clients top down */
-    if (c->win)
-      XMoveWindow(dpy, c->win, c->x, c->y);
+  XMoveWindow(dpy, c->win, x, y);
+  setsentpos(c, x, y);
+}
+
+void
+showhide(Monitor *m)
+{
+  XWindowChanges wc;
+  Client *c;
+
+  /* show clients top down */
+  for (c = m->stack; c; c = c->snext) {
+    if (!ISVISIBLE(c))
+      continue;
     if (c->needresize) {
       c->needresize = 0;
-      XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-    } else {
-      if (c->win)
-        XMoveWindow(dpy, c->win, c->x, c->y);
-    }
+      wc.x = c->x;
+      wc.y = c->y;
+      wc.width = c->w;
+      wc.height = c->h;
+      wc.border_width = c->nextbw;
+      XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
+      setsentpos(c, c->x, c->y);
+      configure(c);
+    } else
+      movewin(c, c->x, c->y);
     if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating) && !ISFULLSCREEN(c))
       resize(c, c->x, c->y, c->w, c->h, 0);
-    showhide(c->snext);
-  } else {
-    /* hide clients bottom up */
-    if (c && c->snext != c)
-      showhide(c->snext);
-    else
-      return;
-    if (c->win)
-      XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
   }
+  /* hide clients bottom up */
+  for (c = m->stacktail; c; c = c->sprev)
+    if (!ISVISIBLE(c))
+      movewin(c, WIDTH(c) * -2, c->y);
+}
+
+/* mirror a committed restack in stackorder: w goes right above or below sib,
+ * or on top if sib is unknown */
+void
+stackplace(Window w, Window sib, int mode)
+{
+  unsigned int i;
+
+  stackremove(w);
+  winlistadd(&stackorder, w);
+  clientlistdirty = 1;
+  for (i = 0; i < stackorder.n - 1 && stackorder.wins[i] != sib; i++);
+  if (i == stackorder.n - 1 || (mode != Above && mode != Below))
+    return;
+  if (mode == Above)
+    i++;
+  memmove(&stackorder.wins[i + 1], &stackorder.wins[i], (stackorder.n - 1 - i) * sizeof(Window));
+  stackorder.wins[i] = w;
+}
+
+void
+stackremove(Window w)
+{
+  unsigned int i;
+
+  for (i = 0; i < stackorder.n && stackorder.wins[i] != w; i++);
+  if (i == stackorder.n)
+    return;
+  memmove(&stackorder.wins[i], &stackorder.wins[i + 1], (stackorder.n - 1 - i) * sizeof(Window));
+  stackorder.n--;
+  clientlistdirty = 1;
 }
 
 void
@@ -2980,6 +4317,139 @@ spawnscratch(const Arg *arg)
   }
 }
 
+/* sets up an alarm on the _NET_WM_SYNC_REQUEST_COUNTER of c if it takes part
+ * in the protocol, *value is the counter's current value */
+XSyncAlarm
+syncalarm(Client *c, long long *value)
+{
+  XSyncAlarmAttributes aa;
+  XSyncAlarm alarm = None;
+  XSyncCounter counter = None;
+  XSyncValue v;
+  Atom *protocols, da;
+  unsigned long dl, nitems;
+  unsigned char *p = NULL;
+  int i, n, di, found = 0;
+
+  if (!havesync)
+    return None;
+  if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+    for (i = 0; i < n; i++)
+      found |= protocols[i] == netatom[NetWMSyncRequest];
+    XFree(protocols);
+  }
+  if (!found)
+    return None;
+  if (XGetWindowProperty(dpy, c->win, netatom[NetWMSyncRequestCounter], 0L, 1L, False,
+    XA_CARDINAL, &da, &di, &nitems, &dl, &p) == Success && p) {
+    if (nitems)
+      counter = *(long *)p;
+    XFree(p);
+  }
+  if (!counter)
+    return None;
+  /* the counter id comes from the client, do not die on a bad one */
+  XSetErrorHandler(xerrordummy);
+  if (XSyncQueryCounter(dpy, counter, &v)) {
+    *value = (long long)XSyncValueHigh32(v) << 32 | XSyncValueLow32(v);
+    aa.trigger.counter = counter;
+    aa.trigger.value_type = XSyncAbsolute;
+    aa.trigger.wait_value = v;
+    aa.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntToValue(&aa.delta, 0);
+    aa.events = True;
+    alarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType|XSyncCAValue
+      |XSyncCATestType|XSyncCADelta|XSyncCAEvents, &aa);
+  }
+  XSync(dpy, False);
+  XSetErrorHandler(xerror);
+  return alarm;
+}
+
+/* resizes c and asks it to bump its counter to value once it has dealt with
+ * the new size, alarm fires when it has; returns 0 without asking if the
+ * geometry is unchanged, as no ConfigureNotify would make the client answer */
+int
+syncresize(Client *c, XSyncAlarm alarm, long long value, int x, int y, int w, int h)
+{
+  XSyncAlarmAttributes aa;
+  XEvent ev;
+
+  if (x == c->x && y == c->y && w == c->w && h == c->h)
+    return 0;
+  XSyncIntsToValue(&aa.trigger.wait_value, value & 0xffffffff, value >> 32);
+  XSyncChangeAlarm(dpy, alarm, XSyncCAValue, &aa);
+  ev.type = ClientMessage;
+  ev.xclient.window = c->win;
+  ev.xclient.message_type = wmatom[WMProtocols];
+  ev.xclient.format = 32;
+  ev.xclient.data.l[0] = netatom[NetWMSyncRequest];
+  ev.xclient.data.l[1] = CurrentTime;
+  ev.xclient.data.l[2] = value & 0xffffffff;
+  ev.xclient.data.l[3] = value >> 32;
+  ev.xclient.data.l[4] = 0;
+  XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+  resize(c, x, y, w, h, 1);
+  return 1;
+}
+
+/* keeps the per-tag counts in Pertag for attached clients; removal goes by
+ * what was counted on insertion, so reindex() is needed after changing the
+ * tags, urgency or floating state of an attached client */
+void
+tagindex(Client *c, int add)
+{
+  Pertag *pt = c->mon->pertag;
+  unsigned int i;
+  int d = add ? 1 : -1;
+
+  if (add == c->indexed)
+    return;
+  if (add) {
+    c->idxtags = c->tags;
+    c->idxurgent = c->isurgent;
+    c->idxfloating = c->isfloating;
+  }
+  c->indexed = add;
+  for (i = 0; i < LENGTH(tags); i++) {
+    if (!(c->idxtags & 1 << i))
+      continue;
+    if (c->idxtags != 255) /* on all tags but the last, see drawbar() */
+      pt->nclients[i] += d;
+    if (c->idxurgent)
+      pt->nurgent[i] += d;
+    if (c->idxfloating)
+      pt->nfloating[i] += d;
+  }
+}
+
+int
+tagsfloating(Monitor *m, unsigned int tagset)
+{
+  unsigned int i;
+
+  for (i = 0; i < LENGTH(tags); i++)
+    if (tagset & 1 << i && m->pertag->nfloating[i])
+      return 1;
+  return 0;
+}
+
+void
+tagsoccupied(Monitor *m, unsigned int *occ, unsigned int *urg)
+{
+  unsigned int i;
+
+  *occ = 0;
+  if (urg)
+    *urg = 0;
+  for (i = 0; i < LENGTH(tags); i++) {
+    if (m->pertag->nclients[i])
+      *occ |= 1 << i;
+    if (urg && m->pertag->nurgent[i])
+      *urg |= 1 << i;
+  }
+}
+
 void
 tag(const Arg *arg)
 {
@@ -2991,9 +4461,11 @@ tag(const Arg *arg)
     fs = ISFULLSCREEN(c);
     if (fs) setfullscreen(c, 0, 0);
     c->tags = arg->ui & TAGMASK;
+    setvisible(c);
+    reindex(c);
     for (i = 0; !(arg->ui & 1 << i); i++);
     setdesktopforclient(c, i+1);
-    if (selmon->sticky != c) {
+    if (STICKY(selmon) != c) {
       detach(c);
       if (selmon->pertag->attachdir[arg->ui & TAGMASK] > 1)
         attachtop(c);
@@ -3185,11 +4657,11 @@ grabfocus(Client *c)
   for(i=0; i < LENGTH(tags) && !((1 << i) & c->tags); i++);
   if(i < LENGTH(tags)) {
     const Arg a = {.ui = 1 << i};
-    if (c->mon->sticky != c) {
+    if (STICKY(c->mon) != c) {
       selmon = c->mon;
       view(&a);
     }
-    Client *fs = c->mon->pertag->fullscreens[c->mon->pertag->curtag];
+    Client *fs = FULLSCREEN(c->mon, c->mon->pertag->curtag);
     if (fs && fs != c && ISFULLSCREEN(fs))
       setfullscreen(fs, 0, 0);
     if (c->isfloating || !c->mon->lt[c->mon->sellt]->arrange
@@ -3230,6 +4702,8 @@ displaybar(Monitor *mon, int tag)
     if (!mon->topbar)
       wc.y = mon->mh - bh;
     XConfigureWindow(dpy, systray->win, CWY, &wc);
+    if (systraystale)
+      updatesystray();
   }
 }
 
@@ -3249,7 +4723,7 @@ hidebar(Monitor *mon, int tag)
 void
 togglebar(const Arg *arg)
 {
-  if (ISFULLSCREEN(selmon->sel) || selmon->pertag->fullscreens[selmon->pertag->curtag])
+  if (ISFULLSCREEN(selmon->sel) || FULLSCREEN(selmon, selmon->pertag->curtag))
     return;
   selmon->pertag->showbars[selmon->pertag->curtag]  ? hidebar(selmon, selmon->pertag->curtag) : displaybar(selmon, selmon->pertag->curtag);
   arrange(selmon);
@@ -3261,6 +4735,8 @@ togglefloating(const Arg *arg)
   if (!selmon->sel || selmon->sel->scratchkey || ISFULLSCREEN(selmon->sel))
     return;
   selmon->sel->isfloating = !selmon->sel->isfloating || selmon->sel->isfixed;
+  reindex(selmon->sel);
+  updateopaque(selmon->sel);
   if (selmon->sel->isfloating)
     /* restore last known float dimensions */
     resize(selmon->sel, selmon->sel->sfx, selmon->sel->sfy,
@@ -3337,10 +4813,11 @@ togglesticky(const Arg *arg)
     return;
   if (ISFULLSCREEN(selmon->sel))
     setfullscreen(selmon->sel, 0, 0);
-  if (selmon->sticky)
-    selmon->sticky = NULL;
-  else if(!selmon->sticky)
-    selmon->sticky = selmon->sel;
+  if (STICKY(selmon))
+    selmon->sticky = clienthandle(NULL);
+  else if(!STICKY(selmon))
+    selmon->sticky = clienthandle(selmon->sel);
+  updatevisible(selmon);
   focus(NULL);
   arrange(selmon);
 }
@@ -3364,7 +4841,7 @@ unfocus(Client *c, int setfocus)
   XSetWindowBorder(dpy, c->win, scheme[SchemeNorm][ColBorder].pixel);
   if (setfocus) {
     XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-    XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+    delprop(root, netatom[NetActiveWindow]);
   }
 }
 
@@ -3375,15 +4852,15 @@ unmanage(Client *c, int destroyed)
   XWindowChanges wc;
   int vis = 0;
 
-  if (c->swallowing) {
+  if (SWALLOWED(c)) {
     unswallow(c);
     return;
   }
 
   Client *s = swallowingclient(c->win);
   if (s) {
-    free(s->swallowing);
-    s->swallowing = NULL;
+    clientfree(SWALLOWED(s));
+    s->swallowing = clienthandle(NULL);
     arrange(m);
     focus(NULL);
     return;
@@ -3392,12 +4869,15 @@ unmanage(Client *c, int destroyed)
   detach(c);
   detachstack(c);
   if (!destroyed) {
+    stackremove(c->win);
     wc.border_width = c->oldbw;
     XGrabServer(dpy); /* avoid race conditions */
     XSetErrorHandler(xerrordummy);
     XSelectInput(dpy, c->win, NoEventMask);
     XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
     XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+    if (c->opaquew)
+      setopaqueregion(c->win, 0, 0);
     setclientstate(c, WithdrawnState);
     XSync(dpy, False);
     XSetErrorHandler(xerror);
@@ -3405,9 +4885,15 @@ unmanage(Client *c, int destroyed)
   }
   if (ISFULLSCREEN(c))
     setfullscreen(c, 0, 0);
-  if (m->sticky == c)
-    m->sticky = NULL;
-  free(c);
+  if (STICKY(m) == c)
+    m->sticky = clienthandle(NULL);
+  if (clickfocus == c)
+    clickfocus = NULL;
+  forgetprops(c->win);
+  if (c->cfgmask)
+    cfgpending--;
+  clientfree(c);
+  updatevisible(m);
   for (c = m->stack; c; c = c->snext) {
     if (ISVISIBLE(c)) {
       vis = 1;
@@ -3455,6 +4941,12 @@ updatebars(void)
     .background_pixmap = ParentRelative,
     .event_mask = ButtonPressMask|ExposureMask
   };
+  /* the pointer crossing into a monitor's empty space enters its catch
+   * window, so root needs no PointerMotionMask to follow monitors */
+  XSetWindowAttributes ca = {
+    .override_redirect = True,
+    .event_mask = EnterWindowMask
+  };
   XClassHint ch = {"dwm", "dwm"};
   for (m = mons; m; m = m->next) {
     if (m->barwin)
@@ -3469,7 +4961,12 @@ updatebars(void)
     if (showsystray && m == systraytomon(m))
       XMapRaised(dpy, systray->win);
     XMapRaised(dpy, m->barwin);
+    stackplace(m->barwin, None, Above);
     XSetClassHint(dpy, m->barwin, &ch);
+    m->catchwin = XCreateWindow(dpy, root, m->mx, m->my, m->mw, m->mh, 0, 0,
+        InputOnly, CopyFromParent, CWOverrideRedirect|CWEventMask, &ca);
+    XLowerWindow(dpy, m->catchwin);
+    XMapWindow(dpy, m->catchwin);
   }
 }
 
@@ -3488,17 +4985,9 @@ updatebarpos(Monitor *m)
 }
 
 void
-updateclientlist()
+updateclientlist(void)
 {
-  Client *c;
-  Monitor *m;
-
-  XDeleteProperty(dpy, root, netatom[NetClientList]);
-  for (m = mons; m; m = m->next)
-    for (c = m->clients; c; c = c->next)
-      XChangeProperty(dpy, root, netatom[NetClientList],
-        XA_WINDOW, 32, PropModeAppend,
-        (unsigned char *) &(c->win), 1);
+  clientlistdirty = 1; /* written by flushbatch() */
 }
 
 void updatecurrentdesktop(void)
@@ -3508,8 +4997,7 @@ void updatecurrentdesktop(void)
   while(*rawdata >> (i+1)){
     i++;
   }
-  long data[] = { i };
-  XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)data, 1);
+  setprop(root, netatom[NetCurrentDesktop], XA_CARDINAL, i);
 }
 
 int
@@ -3517,10 +5005,14 @@ updategeom(void)
 {
   int dirty = 0;
 
+#ifdef XRANDR
+  if (haverandr && updaterrmons(&dirty))
+    ; /* monitors follow the RandR outputs */
+  else
+#endif /* XRANDR */
 #ifdef XINERAMA
   if (XineramaIsActive(dpy)) {
     int i, j, n, nn;
-    Client *c;
     Monitor *m;
     XineramaScreenInfo *info = XineramaQueryScreens(dpy, &nn);
     XineramaScreenInfo *unique = NULL;
@@ -3547,6 +5039,7 @@ updategeom(void)
       || unique[i].width != m->mw || unique[i].height != m->mh)
       {
         dirty = 1;
+        m->relayout = 1;
         m->num = i;
         m->mx = m->wx = unique[i].x_org;
         m->my = m->wy = unique[i].y_org;
@@ -3557,18 +5050,8 @@ updategeom(void)
     /* removed monitors if n > nn */
     for (i = nn; i < n; i++) {
       for (m = mons; m && m->next; m = m->next);
-      while ((c = m->clients)) {
-        dirty = 1;
-        m->clients = c->next;
-        setfullscreen(c, 0, 1);
-        detachstack(c);
-        c->mon = mons;
-        attach(c);
-        attachstack(c);
-      }
-      if (m == selmon)
-        selmon = mons;
-      cleanupmon(m);
+      dirty |= m->clients != NULL;
+      retiremon(m);
     }
     free(unique);
   } else
@@ -3578,6 +5061,7 @@ updategeom(void)
       mons = createmon();
     if (mons->mw != sw || mons->mh != sh) {
       dirty = 1;
+      mons->relayout = 1;
       mons->mw = mons->ww = sw;
       mons->mh = mons->wh = sh;
       updatebarpos(mons);
@@ -3590,6 +5074,214 @@ updategeom(void)
   return dirty;
 }
 
+/* follows a change of the root window or the outputs, only the monitors
+ * that updategeom() touched are laid out again */
+void
+updatemons(int w, int h)
+{
+  Monitor *m;
+  Client *c;
+  int dirty = (sw != w || sh != h);
+
+  sw = w;
+  sh = h;
+  dirty |= updategeom();
+  /* a mode switch at the same size may still change the refresh rate */
+  updaterefresh();
+  if (!dirty)
+    return;
+  updatebars();
+  for (m = mons; m; m = m->next) {
+    if (!m->relayout)
+      continue;
+    m->relayout = 0;
+    XMoveResizeWindow(dpy, m->catchwin, m->mx, m->my, m->mw, m->mh);
+    for (c = m->clients; c; c = c->next)
+      if (ISFULLSCREEN(c) && ISVISIBLE(c))
+        resizeclient(c, m->mx, m->my, m->mw, m->mh);
+    resizebarwin(m);
+    arrange(m);
+  }
+  focus(NULL);
+}
+
+#ifdef XRANDR
+/* matches the RandR monitors to ours by name, existing monitors keep
+ * their clients and state, returns 0 if RandR has nothing to offer */
+int
+updaterrmons(int *dirty)
+{
+  int i, k, j, nn;
+  XRRMonitorInfo *info;
+  Atom *atoms;
+  char **names;
+  const char *name;
+  Monitor *m, *old, **pm, **tail;
+
+  if (!(info = XRRGetMonitors(dpy, root, True, &nn)))
+    return 0;
+  if (nn <= 0) {
+    XRRFreeMonitors(info);
+    return 0;
+  }
+  atoms = ecalloc(nn, sizeof(Atom));
+  names = ecalloc(nn, sizeof(char *));
+  for (i = 0; i < nn; i++)
+    atoms[i] = info[i].name;
+  XGetAtomNames(dpy, atoms, nn, names);
+  /* relink the monitors in RandR order, what is left in old went away */
+  old = mons;
+  mons = NULL;
+  tail = &mons;
+  for (i = 0, j = 0; i < nn; i++) {
+    /* mirrored outputs make one monitor */
+    for (k = 0; k < i; k++)
+      if (info[k].x == info[i].x && info[k].y == info[i].y
+      && info[k].width == info[i].width && info[k].height == info[i].height)
+        break;
+    if (k < i)
+      continue;
+    name = names[i] ? names[i] : "";
+    for (pm = &old; *pm && strcmp((*pm)->output, name); pm = &(*pm)->next);
+    if ((m = *pm))
+      *pm = m->next;
+    else
+      m = createnamedmon(name);
+    m->next = NULL;
+    *tail = m;
+    tail = &m->next;
+    m->num = j++;
+    if (info[i].x != m->mx || info[i].y != m->my
+    || info[i].width != m->mw || info[i].height != m->mh)
+    {
+      *dirty = 1;
+      m->relayout = 1;
+      m->mx = m->wx = info[i].x;
+      m->my = m->wy = info[i].y;
+      m->mw = m->ww = info[i].width;
+      m->mh = m->wh = info[i].height;
+      updatebarpos(m);
+    }
+  }
+  *tail = old;
+  while ((m = old)) {
+    old = m->next;
+    *dirty = 1;
+    retiremon(m);
+  }
+  for (i = 0; i < nn; i++)
+    if (names[i])
+      XFree(names[i]);
+  free(names);
+  free(atoms);
+  XRRFreeMonitors(info);
+  return 1;
+}
+#endif /* XRANDR */
+
+void
+updaterefresh(void)
+{
+  Monitor *m;
+#ifdef XRANDR
+  int i, j, a, best, ev, err;
+  double hz;
+  XRRScreenResources *res;
+  XRRCrtcInfo *crtc, **crtcs;
+  XRRModeInfo *mode;
+
+  if (!XRRQueryExtension(dpy, &ev, &err)
+  || !(res = XRRGetScreenResourcesCurrent(dpy, root))) {
+    for (m = mons; m; m = m->next)
+      m->refresh = 0;
+    return;
+  }
+  /* one round trip per crtc, not per crtc and monitor */
+  crtcs = ecalloc(MAX(res->ncrtc, 1), sizeof *crtcs);
+  for (i = 0; i < res->ncrtc; i++)
+    crtcs[i] = XRRGetCrtcInfo(dpy, res, res->crtcs[i]);
+  /* a monitor takes the rate of the crtc it overlaps the most */
+  for (m = mons; m; m = m->next) {
+    m->refresh = 0;
+    for (best = 0, i = 0; i < res->ncrtc; i++) {
+      if (!(crtc = crtcs[i]))
+        continue;
+      a = INTERSECT(crtc->x, crtc->y, (int)crtc->width, (int)crtc->height, m);
+      if (crtc->mode != None && a > best)
+        for (j = 0; j < res->nmode; j++) {
+          mode = &res->modes[j];
+          if (mode->id != crtc->mode || !mode->hTotal || !mode->vTotal)
+            continue;
+          hz = (double)mode->dotClock / ((double)mode->hTotal * mode->vTotal);
+          if (mode->modeFlags & RR_DoubleScan)
+            hz /= 2;
+          if (mode->modeFlags & RR_Interlace)
+            hz *= 2;
+          best = a;
+          m->refresh = (int)(hz + 0.5);
+          break;
+        }
+    }
+  }
+  for (i = 0; i < res->ncrtc; i++)
+    if (crtcs[i])
+      XRRFreeCrtcInfo(crtcs[i]);
+  free(crtcs);
+  XRRFreeScreenResources(res);
+#else
+  for (m = mons; m; m = m->next)
+    m->refresh = 0;
+#endif /* XRANDR */
+}
+
+/* with tiledopaque, tiled clients are advertised as opaque, floating ones
+ * may be see-through and are left alone */
+void
+updateopaque(Client *c)
+{
+  int w = 0, h = 0;
+
+  if (!c->ownopaque)
+    return;
+  if (!c->isfloating && c->mon->lt[c->mon->sellt]->arrange) {
+    w = c->w;
+    h = c->h;
+  }
+  if (w == c->opaquew && h == c->opaqueh)
+    return;
+  c->opaquew = w;
+  c->opaqueh = h;
+  setopaqueregion(c->win, w, h);
+}
+
+/* a region other than the last one dwm wrote comes from the client, which
+ * is left to keep it from then on */
+void
+updateopaqueowner(Client *c)
+{
+  int format, ours;
+  unsigned long n, extra;
+  unsigned char *p = NULL;
+  long *r;
+  Atom type;
+
+  if (!c->ownopaque || XGetWindowProperty(dpy, c->win, netatom[NetWMOpaqueRegion],
+    0L, 5L, False, AnyPropertyType, &type, &format, &n, &extra, &p) != Success)
+    return;
+  r = (long *)p;
+  if (type == None)
+    ours = !c->opaquew;
+  else
+    ours = type == XA_CARDINAL && format == 32 && n == 4 && !extra
+      && !r[0] && !r[1] && r[2] == c->opaquew && r[3] == c->opaqueh;
+  if (p)
+    XFree(p);
+  if (!ours) {
+    c->ownopaque = 0;
+    c->opaquew = c->opaqueh = 0;
+  }
+}
+
 void
 updatenumlockmask(void)
 {
@@ -3658,8 +5350,12 @@ updatesizehints(Client *c)
 void
 updatestatus(void)
 {
-  if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
-    strcpy(stext, "dwm-"VERSION);
+  /* nobody sees it, fetch only the latest once the bar is back */
+  if (BARFROZEN(selmon)) {
+    statusstale = 1;
+    return;
+  }
+  getstatus();
   drawbar(selmon);
   updatesystray();
 }
@@ -3755,6 +5451,11 @@ updatesystray(void)
       return;
     }
   }
+  if (BARFROZEN(m)) {
+    systraystale = 1;
+    return;
+  }
+  systraystale = 0;
   for (w = 0, i = systray->icons; i; i = i->next) {
     /* make sure the background color stays the same */
     wa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
@@ -3770,6 +5471,10 @@ updatesystray(void)
   w = w ? w + systrayspacing : 1;
   x -= w;
   XMoveResizeWindow(dpy, systray->win, x, m->by, w, bh);
+  if (w != systray->opaquew) {
+    setopaqueregion(systray->win, w, bh);
+    systray->opaquew = w;
+  }
   wc.x = x; wc.y = m->by; wc.width = w; wc.height = bh;
   wc.stack_mode = Below; wc.sibling = m->barwin;
   XConfigureWindow(dpy, systray->win, CWX|CWY|CWWidth|CWHeight|CWSibling|CWStackMode, &wc);
@@ -3784,12 +5489,89 @@ updatesystray(void)
 void
 updatetitle(Client *c)
 {
-  if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-    gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
+  xcb_get_property_cookie_t ck[2];
+  xcb_get_property_reply_t *r;
+  Atom atom[2] = { netatom[NetWMName], XA_WM_NAME };
+  int i, len;
+
+  c->titlestale = 0;
+  c->titletime = getmonotime();
+  c->name[0] = '\0';
+  /* both requests go out at once, UTF8_STRING and STRING are copied as is
+   * and anything else (COMPOUND_TEXT) goes through Xlib's conversion */
+  for (i = 0; i < 2; i++)
+    ck[i] = xcb_get_property(xcon, 0, c->win, atom[i], XCB_GET_PROPERTY_TYPE_ANY,
+      0, sizeof c->name / 4);
+  for (i = 0; i < 2; i++) {
+    if (c->name[0]) {
+      xcb_discard_reply(xcon, ck[i].sequence);
+      continue;
+    }
+    if (!(r = xcb_get_property_reply(xcon, ck[i], NULL)))
+      continue;
+    len = MIN(xcb_get_property_value_length(r), (int)sizeof c->name - 1);
+    if (r->format == 8 && len > 0) {
+      if (r->type == utf8string || r->type == XA_STRING) {
+        memcpy(c->name, xcb_get_property_value(r), len);
+        c->name[len] = '\0';
+      } else
+        gettextprop(c->win, atom[i], c->name, sizeof c->name);
+    }
+    free(r);
+  }
   if (c->name[0] == '\0') /* hack to mark broken clients */
     strcpy(c->name, broken);
 }
 
+/* ISVISIBLE() reads a per-client bit; it has to be refreshed here whenever
+ * the selected tags, curtag, the sticky or the fullscreen client of m change,
+ * and through setvisible() when a client's tags or monitor change */
+void
+updatevisible(Monitor *m)
+{
+  Client *c;
+
+  m->vistags = m->seltags <= 1 ? m->tagset[m->seltags] : 0;
+  m->vissticky = STICKY(m);
+  m->visfull = FULLSCREEN(m, m->pertag->curtag);
+  for (c = m->clients; c; c = c->next)
+    setvisible(c);
+}
+
+/* _NET_WM_WINDOW_TYPE and _NET_WM_STATE are fetched together and kept as
+ * bitmasks of the netatoms dwm knows about */
+void
+updatewinatoms(Client *c, int type, int state)
+{
+  xcb_get_property_cookie_t ck[2];
+  xcb_get_property_reply_t *r;
+  Atom prop[2] = { netatom[NetWMWindowType], netatom[NetWMState] };
+  unsigned int *mask[2] = { &c->wtype, &c->wstate };
+  int want[2] = { type, state };
+  uint32_t *a;
+  int i, j, k, n;
+
+  for (i = 0; i < 2; i++)
+    if (want[i])
+      ck[i] = xcb_get_property(xcon, 0, c->win, prop[i], XCB_ATOM_ATOM, 0, 32);
+  for (i = 0; i < 2; i++) {
+    if (!want[i])
+      continue;
+    *mask[i] = 0;
+    if (!(r = xcb_get_property_reply(xcon, ck[i], NULL)))
+      continue;
+    if (r->format == 32) {
+      a = xcb_get_property_value(r);
+      n = xcb_get_property_value_length(r) / 4;
+      for (j = 0; j < n; j++)
+        for (k = 0; k < NetLast; k++)
+          if (a[j] == netatom[k])
+            *mask[i] |= NETBIT(k);
+    }
+    free(r);
+  }
+}
+
 void
 updatewmhints(Client *c)
 {
@@ -3801,6 +5583,7 @@ updatewmhints(Client *c)
       XSetWMHints(dpy, c->win, wmh);
     } else {
       c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
+      reindex(c);
       if (c->isurgent && c->grabonurgent) {
         grabfocus(c);
       }
@@ -3818,11 +5601,12 @@ view(const Arg *arg)
 {
   int i;
   unsigned int tmptag;
+  Client *fs = NULL;
 
   if ((arg->ui & TAGMASK) == selmon->tagset[selmon->seltags])
     return;
-  if (selmon->sticky && ISFULLSCREEN(selmon->sticky))
-      setfullscreen(selmon->sticky, 0, 0);
+  if (STICKY(selmon) && ISFULLSCREEN(STICKY(selmon)))
+      setfullscreen(STICKY(selmon), 0, 0);
   selmon->seltags ^= 1; /* toggle sel tagset */
   if (arg->ui & TAGMASK) {
     selmon->tagset[selmon->seltags] = arg->ui & TAGMASK;
@@ -3831,19 +5615,21 @@ view(const Arg *arg)
     if (arg->ui == ~0) {
       selmon->pertag->curtag = 0;
       for (i = 0; i <= LENGTH(tags); i++)
-        setfullscreenontag(selmon->pertag->fullscreens[i], 0, i, 0);
+        setfullscreenontag(FULLSCREEN(selmon, i), 0, i, 0);
     } else {
       for (i = 0; !(arg->ui & 1 << i); i++) ;
       selmon->pertag->curtag = i + 1;
-      Client *fs = selmon->pertag->fullscreens[i];
-      if (fs)
-        focus(fs);
+      fs = FULLSCREEN(selmon, i);
     }
   } else {
     tmptag = selmon->pertag->prevtag;
     selmon->pertag->prevtag = selmon->pertag->curtag;
     selmon->pertag->curtag = tmptag;
   }
+  /* before focus(), which only accepts visible clients */
+  updatevisible(selmon);
+  if (fs)
+    focus(fs);
 
   selmon->nmaster = selmon->pertag->nmasters[selmon->pertag->curtag];
   selmon->mfact = selmon->pertag->mfacts[selmon->pertag->curtag];
@@ -3854,12 +5640,13 @@ view(const Arg *arg)
   selmon->pertag->showbars[selmon->pertag->curtag] ? displaybar(selmon, selmon->pertag->curtag) : hidebar(selmon, selmon->pertag->curtag);
 
   if (selmon->pertag->prevtag == 0) {
-    setfullscreenontag(selmon->pertag->fullscreens[0], 0, 0, 0);
+    setfullscreenontag(FULLSCREEN(selmon, 0), 0, 0, 0);
     for (Client *k = selmon->clients; k; k = k->next) {
       if (ISVISIBLE(k)) {
         for (i = 0; !(arg->ui & 1 << i); i++);
         setdesktopforclient(k, i+1);
         k->tags = arg->ui & TAGMASK;
+        reindex(k);
       }
     }
   }
@@ -3979,7 +5766,7 @@ termforwin(const Client *w)
 
   for (m = mons; m; m = m->next) {
     for (c = m->clients; c; c = c->next) {
-      if (c->isterminal && !c->swallowing && c->pid) {
+      if (c->isterminal && !SWALLOWED(c) && c->pid) {
         int d = isdescprocess(c->pid, w->pid);
         if (d && mindepth > d) {
           mindepth = d;
@@ -3995,12 +5782,14 @@ termforwin(const Client *w)
 Client *
 swallowingclient(Window w)
 {
-  Client *c;
-  Monitor *m;
+  Client *c, *s;
+  Slab *sl;
+  int i;
 
-  for (m = mons; m; m = m->next) {
-    for (c = m->clients; c; c = c->next) {
-      if (c->swallowing && c->swallowing->win == w)
+  for (sl = slabs; sl; sl = sl->next) {
+    for (i = 0; i < POOLSLAB; i++) {
+      c = &sl->c[i];
+      if (c->gen & 1 && (s = SWALLOWED(c)) && s->win == w)
         return c;
     }
   }
@@ -4008,6 +5797,25 @@ swallowingclient(Window w)
   return NULL;
 }
 
+int
+wincmp(const void *a, const void *b)
+{
+  Window x = *(const Window *)a, y = *(const Window *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+void
+winlistadd(WinList *l, Window w)
+{
+  if (l->n == l->size) {
+    l->size = l->size ? l->size * 2 : 64;
+    if (!(l->wins = realloc(l->wins, l->size * sizeof(Window))))
+      die("fatal: could not realloc() %u bytes\n", l->size * sizeof(Window));
+  }
+  l->wins[l->n++] = w;
+}
+
 Client *
 wintoclient(Window w)
 {
@@ -4042,7 +5850,7 @@ wintomon(Window w)
   if (w == root && getrootptr(&x, &y))
     return recttomon(x, y, 1, 1);
   for (m = mons; m; m = m->next)
-    if (w == m->barwin)
+    if (w == m->barwin || w == m->catchwin)
       return m;
   if ((c = wintoclient(w)))
     return c->mon;